@@ -22,6 +22,7 @@
 #include <Hwcomposer.h>
 #include <DisplayAnalyzer.h>
 #include <cutils/properties.h>
+#include <cutils/atomic.h>
 #include <GraphicBuffer.h>
 #include <ExternalDevice.h>
 #include <VirtualDevice.h>
@@ -41,10 +42,13 @@ DisplayAnalyzer::DisplayAnalyzer()
       mProtectedVideoSession(false),
       mCachedNumDisplays(0),
       mCachedDisplays(0),
-      mPendingEvents(),
-      mEventMutex(),
+      mEventHead(0),
+      mEventTail(0),
+      mCoalescedMask(0),
+      mDroppedEvents(0),
       mEventHandledCondition()
 {
+    resetEvents();
 }
 
 DisplayAnalyzer::~DisplayAnalyzer()
@@ -67,7 +71,7 @@ bool DisplayAnalyzer::initialize()
     mProtectedVideoSession = false;
     mCachedNumDisplays = 0;
     mCachedDisplays = 0;
-    mPendingEvents.clear();
+    resetEvents();
     mVideoStateMap.clear();
     mInitialized = true;
 
@@ -76,7 +80,7 @@ bool DisplayAnalyzer::initialize()
 
 void DisplayAnalyzer::deinitialize()
 {
-    mPendingEvents.clear();
+    resetEvents();
     mVideoStateMap.clear();
     mInitialized = false;
 }
@@ -254,12 +258,11 @@ bool DisplayAnalyzer::isVideoLayer(hwc_layer_1_t &layer)
     if (!layer.handle) {
         return false;
     }
-    DataBuffer *buffer = bm->lockDataBuffer(layer.handle);
-     if (!buffer) {
-         ETRACE("failed to get buffer");
-     } else {
-        ret = DisplayQuery::isVideoFormat(buffer->getFormat());
-        bm->unlockDataBuffer(buffer);
+    BufferInfo info;
+    if (!bm->getBufferInfo(layer.handle, info)) {
+        ETRACE("failed to get buffer");
+    } else {
+        ret = DisplayQuery::isVideoFormat(info.getFormat());
     }
     return ret;
 }
@@ -337,14 +340,11 @@ void DisplayAnalyzer::postVideoEvent(int instanceID, int state)
         for (int i = 0; i < (int)mCachedNumDisplays; i++) {
             setCompositionType(i, HWC_FRAMEBUFFER, true);
         }
-        // wait for up to 100ms until overlay is disabled.
-        int loop = 0;
-        while (loop++ < 6) {
-            if (Hwcomposer::getInstance().getPlaneManager()->isOverlayPlanesDisabled())
-                break;
-            usleep(16700);
-        }
-        if (loop >= 6) {
+        // wait for up to 100ms until overlay is disabled, the plane manager
+        // wakes us up as soon as the reclaimed overlays are off
+        DisplayPlaneManager *planeManager = Hwcomposer::getInstance().getPlaneManager();
+        if (!planeManager->waitForOverlayPlanesDisabled(
+                milliseconds(OVERLAY_DISABLE_TIMEOUT_MS))) {
             WTRACE("timeout disabling overlay ");
         }
     }
@@ -376,23 +376,110 @@ void DisplayAnalyzer::postIdleEntryEvent(void)
     postEvent(e);
 }
 
+bool DisplayAnalyzer::isCoalescedEvent(int type)
+{
+    // only the latest state matters for these
+    return type == BLANK_EVENT ||
+           type == INPUT_EVENT ||
+           type == IDLE_ENTRY_EVENT ||
+           type == VIDEO_CHECK_EVENT;
+}
+
+void DisplayAnalyzer::resetEvents()
+{
+    // no producer or consumer is running
+    for (int i = 0; i < EVENT_RING_SIZE; i++) {
+        mEventRing[i].sequence = i;
+    }
+    for (int i = 0; i < EVENT_TYPE_COUNT; i++) {
+        mCoalescedValue[i] = 0;
+    }
+    mEventHead = 0;
+    mEventTail = 0;
+    mCoalescedMask = 0;
+    mDroppedEvents = 0;
+}
+
 void DisplayAnalyzer::postEvent(Event& e)
 {
-    Mutex::Autolock lock(mEventMutex);
-    mPendingEvents.add(e);
+    if (isCoalescedEvent(e.type)) {
+        int32_t value = (e.type == BLANK_EVENT || e.type == INPUT_EVENT) ?
+            e.bValue : e.nValue;
+        android_atomic_release_store(value, &mCoalescedValue[e.type]);
+        int32_t bit = 1 << e.type;
+        if (android_atomic_or(bit, &mCoalescedMask) & bit) {
+            // a token is queued already and will pick up the new value
+            return;
+        }
+    }
+
+    int32_t pos = android_atomic_acquire_load(&mEventHead);
+    EventSlot *slot;
+    for (;;) {
+        slot = &mEventRing[pos & (EVENT_RING_SIZE - 1)];
+        int32_t diff = android_atomic_acquire_load(&slot->sequence) - pos;
+        if (diff == 0) {
+            // claim the position
+            if (android_atomic_cas(pos, pos + 1, &mEventHead) == 0) {
+                break;
+            }
+            pos = android_atomic_acquire_load(&mEventHead);
+        } else if (diff < 0) {
+            // the consumer has not freed this slot yet
+            ETRACE("event queue is full, dropping event %d", e.type);
+            android_atomic_inc(&mDroppedEvents);
+            if (isCoalescedEvent(e.type)) {
+                android_atomic_and(~(1 << e.type), &mCoalescedMask);
+            }
+            return;
+        } else {
+            // another producer claimed it first
+            pos = android_atomic_acquire_load(&mEventHead);
+        }
+    }
+
+    slot->event = e;
+    android_atomic_release_store(pos + 1, &slot->sequence);
 }
 
 bool DisplayAnalyzer::getEvent(Event& e)
 {
-    Mutex::Autolock lock(mEventMutex);
-    if (mPendingEvents.size() == 0) {
+    EventSlot& slot = mEventRing[mEventTail & (EVENT_RING_SIZE - 1)];
+    if (android_atomic_acquire_load(&slot.sequence) != mEventTail + 1) {
         return false;
     }
-    e = mPendingEvents[0];
-    mPendingEvents.removeAt(0);
+
+    e = slot.event;
+    android_atomic_release_store(mEventTail + EVENT_RING_SIZE, &slot.sequence);
+    mEventTail++;
+
+    if (isCoalescedEvent(e.type)) {
+        // clear the bit before reading the value, a later post then
+        // queues a new token instead of being lost
+        android_atomic_and(~(1 << e.type), &mCoalescedMask);
+        int32_t value = android_atomic_acquire_load(&mCoalescedValue[e.type]);
+        if (e.type == BLANK_EVENT || e.type == INPUT_EVENT) {
+            e.bValue = value != 0;
+        } else {
+            e.nValue = value;
+        }
+    }
     return true;
 }
 
+void DisplayAnalyzer::dump(Dump& d)
+{
+    int32_t head = android_atomic_acquire_load(&mEventHead);
+    d.append("Display analyzer: video ext mode %s%s, overlay %s\n",
+             mVideoExtModeEnabled ? "enabled" : "disabled",
+             mVideoExtModeActive ? " (active)" : "",
+             mOverlayAllowed ? "allowed" : "disallowed");
+    // the tail is owned by the prepare thread, pending is a rough count
+    d.append("  events: posted %d, pending %d, dropped %d\n",
+             head, head - mEventTail,
+             android_atomic_acquire_load(&mDroppedEvents));
+}
+
 void DisplayAnalyzer::handlePendingEvents()
 {
     // handle one event per analysis to avoid blocking surface flinger
@@ -847,12 +934,11 @@ bool DisplayAnalyzer::isProtectedLayer(hwc_layer_1_t &layer)
     }
     bool ret = false;
     BufferManager *bm = Hwcomposer::getInstance().getBufferManager();
-    DataBuffer *buffer = bm->lockDataBuffer(layer.handle);
-    if (!buffer) {
+    BufferInfo info;
+    if (!bm->getBufferInfo(layer.handle, info)) {
         ETRACE("failed to get buffer");
     } else {
-        ret = GraphicBuffer::isProtectedBuffer((GraphicBuffer*)buffer);
-        bm->unlockDataBuffer(buffer);
+        ret = info.isProtected();
     }
     return ret;
 }
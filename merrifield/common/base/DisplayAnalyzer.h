@@ -18,6 +18,7 @@
 
 #include <utils/threads.h>
 #include <utils/Vector.h>
+#include <Dump.h>
 
 
 namespace android {
@@ -49,6 +50,7 @@ public:
     bool isProtectedLayer(hwc_layer_1_t &layer);
     bool ignoreVideoSkipFlag();
     int  getFirstVideoInstanceSessionID();
+    void dump(Dump& d);
 
 private:
     enum DisplayEventType {
@@ -61,6 +63,7 @@ private:
         IDLE_ENTRY_EVENT,
         IDLE_EXIT_EVENT,
         VIDEO_CHECK_EVENT,
+        EVENT_TYPE_COUNT,
     };
 
     struct Event {
@@ -79,6 +82,8 @@ private:
     };
     inline void postEvent(Event& e);
     inline bool getEvent(Event& e);
+    inline void resetEvents();
+    inline bool isCoalescedEvent(int type);
     void handlePendingEvents();
     void handleHotplugEvent(bool connected);
     void handleBlankEvent(bool blank);
@@ -114,6 +119,18 @@ private:
     {
         // number of flips before display can be powered off in video extended mode
         DELAY_BEFORE_DPMS_OFF = 0,
+        // how long a video event waits for overlays to be disabled
+        OVERLAY_DISABLE_TIMEOUT_MS = 100,
+        // must be a power of two
+        EVENT_RING_SIZE = 64,
+    };
+
+    // bounded multi-producer single-consumer ring, a slot is free for
+    // position p when its sequence is p and holds the event of position p
+    // when its sequence is p + 1
+    struct EventSlot {
+        volatile int32_t sequence;
+        Event event;
     };
 
 private:
@@ -132,8 +149,16 @@ private:
     KeyedVector<int, int> mVideoStateMap;
     int mCachedNumDisplays;
     hwc_display_contents_1_t** mCachedDisplays;
-    Vector<Event> mPendingEvents;
-    Mutex mEventMutex;
+    EventSlot mEventRing[EVENT_RING_SIZE];
+    // next position to post, shared by producers
+    volatile int32_t mEventHead;
+    // next position to handle, prepare thread only
+    int32_t mEventTail;
+    // state events only queue a token and keep their latest value here,
+    // bit n of the mask is set while a token of type n is queued
+    volatile int32_t mCoalescedMask;
+    volatile int32_t mCoalescedValue[EVENT_TYPE_COUNT];
+    volatile int32_t mDroppedEvents;
     Condition mEventHandledCondition;
 };
 
@@ -15,6 +15,7 @@
 */
 #include <fcntl.h>
 #include <errno.h>
+#include <cutils/atomic.h>
 #include <HwcTrace.h>
 #include <IDisplayDevice.h>
 #include <DrmConfig.h>
@@ -25,11 +26,17 @@ namespace android {
 namespace intel {
 
 Drm::Drm()
-    : mDrmFd(0),
+    : mEncoders(),
+      mCrtcIds(),
+      mTopologyValid(false),
+      mDrmFd(0),
       mLock(),
+      mProbeLock(),
       mInitialized(false)
 {
     memset(&mOutputs, 0, sizeof(mOutputs));
+    memset(&mConnectorIds, 0, sizeof(mConnectorIds));
+    memset(&mIoctlStats, 0, sizeof(mIoctlStats));
 }
 
 Drm::~Drm()
@@ -54,6 +61,11 @@ bool Drm::initialize()
 
     memset(&mOutputs, 0, sizeof(mOutputs));
     mInitialized = true;
+
+    // retried on the first detect if this fails
+    if (!initTopology()) {
+        WTRACE("failed to get drm topology");
+    }
     return true;
 }
 
@@ -67,150 +79,213 @@ void Drm::deinitialize()
         close(mDrmFd);
         mDrmFd = 0;
     }
+    mEncoders.clear();
+    mCrtcIds.clear();
+    mTopologyValid = false;
     mInitialized = false;
 }
 
-bool Drm::detect(int device)
+bool Drm::initTopology()
 {
-    RETURN_FALSE_IF_NOT_INIT();
-
-    Mutex::Autolock _l(mLock);
-    int outputIndex = getOutputIndex(device);
-    if (outputIndex < 0 ) {
-        return false;
-    }
-
-    resetOutput(outputIndex);
-
-    // get drm resources
     drmModeResPtr resources = drmModeGetResources(mDrmFd);
     if (!resources) {
         ETRACE("fail to get drm resources, error: %s", strerror(errno));
         return false;
     }
 
-    drmModeConnectorPtr connector = NULL;
-    DrmOutput *output = &mOutputs[outputIndex];
-    bool ret = false;
+    memset(&mConnectorIds, 0, sizeof(mConnectorIds));
+    mEncoders.clear();
+    mCrtcIds.clear();
 
-    // find connector for the given device
+    // first connector of the configured type for each output
     for (int i = 0; i < resources->count_connectors; i++) {
         if (!resources->connectors || !resources->connectors[i]) {
             ETRACE("fail to get drm resources connectors, error: %s", strerror(errno));
             continue;
         }
 
-        connector = drmModeGetConnector(mDrmFd, resources->connectors[i]);
+        drmModeConnectorPtr connector = drmModeGetConnector(mDrmFd, resources->connectors[i]);
         if (!connector) {
             ETRACE("drmModeGetConnector failed");
             continue;
         }
 
-        if (connector->connector_type != DrmConfig::getDrmConnector(device)) {
-            drmModeFreeConnector(connector);
+        for (int device = IDisplayDevice::DEVICE_PRIMARY;
+             device <= IDisplayDevice::DEVICE_EXTERNAL; device++) {
+            int outputIndex = getOutputIndex(device);
+            if (outputIndex >= 0 && !mConnectorIds[outputIndex] &&
+                connector->connector_type == DrmConfig::getDrmConnector(device)) {
+                mConnectorIds[outputIndex] = connector->connector_id;
+            }
+        }
+        drmModeFreeConnector(connector);
+    }
+
+    for (int i = 0; i < resources->count_encoders; i++) {
+        if (!resources->encoders || !resources->encoders[i]) {
+            ETRACE("fail to get drm resources encoders, error: %s", strerror(errno));
+            continue;
+        }
+
+        drmModeEncoderPtr encoder = drmModeGetEncoder(mDrmFd, resources->encoders[i]);
+        if (!encoder) {
+            ETRACE("drmModeGetEncoder failed");
             continue;
         }
+        DrmEncoder entry;
+        entry.id = encoder->encoder_id;
+        entry.type = encoder->encoder_type;
+        mEncoders.add(entry);
+        drmModeFreeEncoder(encoder);
+    }
 
-        if (connector->connection != DRM_MODE_CONNECTED) {
-            ITRACE("device %d is not connected", device);
-            drmModeFreeConnector(connector);
-            ret = true;
-            break;
+    for (int i = 0; i < resources->count_crtcs; i++) {
+        if (!resources->crtcs || !resources->crtcs[i]) {
+            ETRACE("fail to get drm resources crtcs, error: %s", strerror(errno));
+            continue;
         }
+        mCrtcIds.add(resources->crtcs[i]);
+    }
 
-        output->connector = connector;
-        output->connected = true;
+    drmModeFreeResources(resources);
 
-        // get proper encoder for the given connector
-        if (connector->encoder_id) {
-            ITRACE("Drm connector has encoder attached on device %d", device);
-            output->encoder = drmModeGetEncoder(mDrmFd, connector->encoder_id);
-            if (!output->encoder) {
-                ETRACE("failed to get encoder from a known encoder id");
-                // fall through to get an encoder
-            }
+    ITRACE("drm topology: connectors %u/%u, %d encoders, %d crtcs",
+           mConnectorIds[OUTPUT_PRIMARY], mConnectorIds[OUTPUT_EXTERNAL],
+           (int)mEncoders.size(), (int)mCrtcIds.size());
+    mTopologyValid = true;
+    return true;
+}
+
+bool Drm::probeOutput(int device, int outputIndex, DrmOutput& output)
+{
+    uint32_t connectorId = mConnectorIds[outputIndex];
+    if (!connectorId) {
+        return false;
+    }
+
+    // refreshes connection state and modes, may re-read EDID
+    drmModeConnectorPtr connector = drmModeGetConnector(mDrmFd, connectorId);
+    if (!connector) {
+        ETRACE("drmModeGetConnector failed");
+        return false;
+    }
+
+    if (connector->connection != DRM_MODE_CONNECTED) {
+        ITRACE("device %d is not connected", device);
+        drmModeFreeConnector(connector);
+        return true;
+    }
+
+    output.connector = connector;
+    output.connected = true;
+
+    // get proper encoder for the given connector
+    if (connector->encoder_id) {
+        ITRACE("Drm connector has encoder attached on device %d", device);
+        output.encoder = drmModeGetEncoder(mDrmFd, connector->encoder_id);
+        if (!output.encoder) {
+            ETRACE("failed to get encoder from a known encoder id");
+            // fall through to get an encoder
         }
-        if (!output->encoder) {
-            ITRACE("getting encoder for device %d", device);
-            drmModeEncoderPtr encoder;
-            for (int j = 0; j < resources->count_encoders; j++) {
-                if (!resources->encoders || !resources->encoders[j]) {
-                    ETRACE("fail to get drm resources encoders, error: %s", strerror(errno));
-                    continue;
-                }
-
-                encoder = drmModeGetEncoder(mDrmFd, resources->encoders[i]);
-                if (!encoder) {
-                    ETRACE("drmModeGetEncoder failed");
-                    continue;
-                }
-                if (encoder->encoder_type == DrmConfig::getDrmEncoder(device)) {
-                    output->encoder = encoder;
-                    break;
-                }
-                drmModeFreeEncoder(encoder);
-                encoder = NULL;
+    }
+    if (!output.encoder) {
+        ITRACE("getting encoder for device %d", device);
+        for (size_t i = 0; i < mEncoders.size(); i++) {
+            if (mEncoders[i].type != DrmConfig::getDrmEncoder(device)) {
+                continue;
             }
+            output.encoder = drmModeGetEncoder(mDrmFd, mEncoders[i].id);
+            if (output.encoder) {
+                break;
+            }
+            ETRACE("drmModeGetEncoder failed");
         }
-        if (!output->encoder) {
-            ETRACE("failed to get drm encoder");
-            break;
-        }
+    }
+    if (!output.encoder) {
+        ETRACE("failed to get drm encoder");
+        return false;
+    }
 
-        // get an attached crtc or spare crtc
-        if (output->encoder->crtc_id) {
-            ITRACE("Drm encoder has crtc attached on device %d", device);
-            output->crtc = drmModeGetCrtc(mDrmFd, output->encoder->crtc_id);
-            if (!output->crtc) {
-                ETRACE("failed to get crtc from a known crtc id");
-                // fall through to get a spare crtc
-            }
+    // get an attached crtc or spare crtc
+    if (output.encoder->crtc_id) {
+        ITRACE("Drm encoder has crtc attached on device %d", device);
+        output.crtc = drmModeGetCrtc(mDrmFd, output.encoder->crtc_id);
+        if (!output.crtc) {
+            ETRACE("failed to get crtc from a known crtc id");
+            // fall through to get a spare crtc
         }
-        if (!output->crtc) {
-            ITRACE("getting crtc for device %d", device);
-            drmModeCrtcPtr crtc;
-            for (int j = 0; j < resources->count_crtcs; j++) {
-                if (!resources->crtcs || !resources->crtcs[j]) {
-                    ETRACE("fail to get drm resources crtcs, error: %s", strerror(errno));
-                    continue;
-                }
-
-                crtc = drmModeGetCrtc(mDrmFd, resources->crtcs[j]);
-                if (!crtc) {
-                    ETRACE("drmModeGetCrtc failed");
-                    continue;
-                }
-                if (crtc->buffer_id == 0) {
-                    output->crtc = crtc;
-                    break;
-                }
-                drmModeFreeCrtc(crtc);
+    }
+    if (!output.crtc) {
+        ITRACE("getting crtc for device %d", device);
+        for (size_t i = 0; i < mCrtcIds.size(); i++) {
+            drmModeCrtcPtr crtc = drmModeGetCrtc(mDrmFd, mCrtcIds[i]);
+            if (!crtc) {
+                ETRACE("drmModeGetCrtc failed");
+                continue;
             }
+            if (crtc->buffer_id == 0) {
+                output.crtc = crtc;
+                break;
+            }
+            drmModeFreeCrtc(crtc);
         }
-        if (!output->crtc) {
-            ETRACE("failed to get drm crtc");
-            break;
-        }
+    }
+    if (!output.crtc) {
+        ETRACE("failed to get drm crtc");
+        return false;
+    }
 
-        // current mode
-        if (output->crtc->mode_valid) {
-            ITRACE("mode is valid, kernel mode settings");
-            memcpy(&output->mode, &output->crtc->mode, sizeof(drmModeModeInfo));
-            ret = true;
-        } else {
-            ITRACE("mode is invalid, setting preferred mode");
-            ret = initDrmMode(outputIndex);
-        }
+    // current mode
+    if (output.crtc->mode_valid) {
+        ITRACE("mode is valid, kernel mode settings");
+        memcpy(&output.mode, &output.crtc->mode, sizeof(drmModeModeInfo));
+    }
 
-        if (outputIndex == OUTPUT_PRIMARY) {
-            if (!readIoctl(DRM_PSB_PANEL_ORIENTATION, &output->panelOrientation, sizeof(int))) {
-                ETRACE("failed to get device %d orientation", device);
-                output->panelOrientation = PANEL_ORIENTATION_0;
-            }
-        } else {
-            output->panelOrientation = PANEL_ORIENTATION_0;
+    if (outputIndex == OUTPUT_PRIMARY) {
+        if (!readIoctl(DRM_PSB_PANEL_ORIENTATION, &output.panelOrientation, sizeof(int))) {
+            ETRACE("failed to get device %d orientation", device);
+            output.panelOrientation = PANEL_ORIENTATION_0;
         }
-        break;
+    } else {
+        output.panelOrientation = PANEL_ORIENTATION_0;
+    }
+    return true;
+}
+
+bool Drm::detect(int device)
+{
+    RETURN_FALSE_IF_NOT_INIT();
+
+    int outputIndex = getOutputIndex(device);
+    if (outputIndex < 0 ) {
+        return false;
+    }
+
+    // probe without mLock so the prepare thread does not wait for it
+    Mutex::Autolock _p(mProbeLock);
+
+    if (!mTopologyValid && !initTopology()) {
+        return false;
+    }
+
+    DrmOutput probed;
+    memset(&probed, 0, sizeof(probed));
+    bool ret = probeOutput(device, outputIndex, probed);
+
+    Mutex::Autolock _l(mLock);
+
+    resetOutput(outputIndex);
+    DrmOutput *output = &mOutputs[outputIndex];
+    output->connector = probed.connector;
+    output->encoder = probed.encoder;
+    output->crtc = probed.crtc;
+    output->connected = probed.connected;
+    output->panelOrientation = probed.panelOrientation;
+    memcpy(&output->mode, &probed.mode, sizeof(drmModeModeInfo));
+
+    if (ret && output->connected && !output->crtc->mode_valid) {
+        ITRACE("mode is invalid, setting preferred mode");
+        ret = initDrmMode(outputIndex);
     }
 
     if (!ret) {
@@ -225,7 +300,6 @@ bool Drm::detect(int device)
         ITRACE("mode is: %dx%d@%dHz", output->mode.hdisplay, output->mode.vdisplay, output->mode.vrefresh);
     }
 
-    drmModeFreeResources(resources);
     return ret;
 }
 
@@ -348,7 +422,9 @@ bool Drm::writeReadIoctl(unsigned long cmd, void *data,
         return false;
     }
 
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     err = drmCommandWriteRead(mDrmFd, cmd, data, size);
+    recordIoctl(cmd, start, err != 0);
     if (err) {
         WTRACE("failed to call %ld ioctl with failure %d", cmd, err);
         return false;
@@ -372,7 +448,9 @@ bool Drm::writeIoctl(unsigned long cmd, void *data,
         return false;
     }
 
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     err = drmCommandWrite(mDrmFd, cmd, data, size);
+    recordIoctl(cmd, start, err != 0);
     if (err) {
         WTRACE("failed to call %ld ioctl with failure %d", cmd, err);
         return false;
@@ -397,7 +475,9 @@ bool Drm::readIoctl(unsigned long cmd, void *data,
         return false;
     }
 
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     err = drmCommandRead(mDrmFd, cmd, data, size);
+    recordIoctl(cmd, start, err != 0);
     if (err) {
         WTRACE("failed to call %ld ioctl with failure %d", cmd, err);
         return false;
@@ -407,6 +487,106 @@ bool Drm::readIoctl(unsigned long cmd, void *data,
 }
 
 
+bool Drm::commandIoctl(unsigned long cmd)
+{
+    int err;
+
+    if (mDrmFd <= 0) {
+        ETRACE("drm is not initialized");
+        return false;
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    err = drmCommandNone(mDrmFd, cmd);
+    recordIoctl(cmd, start, err != 0);
+    if (err) {
+        WTRACE("failed to call %ld ioctl with failure %d", cmd, err);
+        return false;
+    }
+
+    return true;
+}
+
+void Drm::recordIoctl(unsigned long cmd, nsecs_t start, bool failed)
+{
+    if (cmd >= IOCTL_COMMAND_COUNT) {
+        return;
+    }
+
+    int32_t us = (int32_t)((systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1000);
+    int bucket = 0;
+    while (bucket < IOCTL_BUCKET_COUNT - 1 &&
+           (us >> (IOCTL_FIRST_BUCKET_SHIFT + bucket)) > 0) {
+        bucket++;
+    }
+
+    IoctlStats& stats = mIoctlStats[cmd];
+    android_atomic_inc(&stats.count);
+    android_atomic_inc(&stats.buckets[bucket]);
+    if (failed) {
+        android_atomic_inc(&stats.failures);
+    }
+
+    int32_t maxUs = stats.maxUs;
+    while (us > maxUs) {
+        if (android_atomic_cas(maxUs, us, &stats.maxUs) == 0) {
+            break;
+        }
+        maxUs = stats.maxUs;
+    }
+}
+
+static const struct {
+    unsigned long cmd;
+    const char *name;
+} sIoctlNames[] = {
+    { DRM_PSB_REGISTER_RW, "REGISTER_RW" },
+    { DRM_PSB_GTT_MAP, "GTT_MAP" },
+    { DRM_PSB_GTT_UNMAP, "GTT_UNMAP" },
+    { DRM_PSB_VSYNC_SET, "VSYNC_SET" },
+    { DRM_PSB_UPDATE_CURSOR_POS, "UPDATE_CURSOR_POS" },
+    { DRM_PSB_PM_SET, "PM_SET" },
+    { DRM_PSB_PANEL_QUERY, "PANEL_QUERY" },
+    { DRM_PSB_PANEL_ORIENTATION, "PANEL_ORIENTATION" },
+    { DRM_PSB_EXTENSION, "EXTENSION" },
+    { DRM_PSB_ENABLE_HDCP, "ENABLE_HDCP" },
+    { DRM_PSB_DISABLE_HDCP, "DISABLE_HDCP" },
+    { DRM_PSB_QUERY_HDCP, "QUERY_HDCP" },
+    { DRM_PSB_GET_HDCP_LINK_STATUS, "HDCP_LINK_STATUS" },
+    { DRM_PSB_HDCP_DISPLAY_IED_ON, "HDCP_IED_ON" },
+    { DRM_PSB_HDCP_DISPLAY_IED_OFF, "HDCP_IED_OFF" },
+};
+
+void Drm::dump(Dump& d)
+{
+    d.append("DRM ioctls (latency histogram, us):\n");
+    d.append(" CMD | NAME              |   COUNT | FAIL |  MAX us |"
+             "  <16  <32  <64 <128 <256 <512  <1K  <2K  <4K  <8K <16K >=16K\n");
+    d.append("-----+-------------------+---------+------+---------+"
+             "------------------------------------------------------------\n");
+    for (int i = 0; i < IOCTL_COMMAND_COUNT; i++) {
+        const IoctlStats& stats = mIoctlStats[i];
+        if (!stats.count) {
+            continue;
+        }
+
+        const char *name = "";
+        for (size_t j = 0; j < sizeof(sIoctlNames) / sizeof(sIoctlNames[0]); j++) {
+            if (sIoctlNames[j].cmd == (unsigned long)i) {
+                name = sIoctlNames[j].name;
+                break;
+            }
+        }
+
+        d.append("0x%02x | %-17s | %7d | %4d | %7d |",
+                 i, name, stats.count, stats.failures, stats.maxUs);
+        for (int j = 0; j < IOCTL_BUCKET_COUNT; j++) {
+            d.append(" %4d", stats.buckets[j]);
+        }
+        d.append("\n");
+    }
+}
+
 int Drm::getDrmFd() const
 {
     return mDrmFd;
@@ -17,6 +17,9 @@
 #define __DRM_H__
 
 #include <utils/Mutex.h>
+#include <utils/Vector.h>
+#include <utils/Timers.h>
+#include <Dump.h>
 #include <hardware/hwcomposer.h>
 
 // TODO: psb_drm.h is IP specific defintion
@@ -51,6 +54,7 @@ public:
                       unsigned long size);
     bool readIoctl(unsigned long cmd, void *data,
                       unsigned long size);
+    bool commandIoctl(unsigned long cmd);
 
     bool isConnected(int device);
     bool setDpmsMode(int device, int mode);
@@ -60,14 +64,18 @@ public:
     bool isSameDrmMode(drmModeModeInfoPtr mode, drmModeModeInfoPtr base) const;
     int getPanelOrientation(int device);
     drmModeModeInfoPtr detectAllConfigs(int device, int *modeCount);
+    // per command call counts and latency histograms
+    void dump(Dump& d);
 
 private:
+    bool initTopology();
     bool initDrmMode(int index);
     bool setDrmMode(int index, drmModeModeInfoPtr mode);
     void resetOutput(int index);
 
     // map device type to output index, return -1 if not mapped
     inline int getOutputIndex(int device);
+    inline void recordIoctl(unsigned long cmd, nsecs_t start, bool failed);
 
 private:
     // DRM object index
@@ -88,8 +96,38 @@ private:
         int panelOrientation;
     } mOutputs[OUTPUT_MAX];
 
+    bool probeOutput(int device, int index, DrmOutput& output);
+
+    // DRM object ids found once, they do not change at runtime
+    struct DrmEncoder {
+        uint32_t id;
+        uint32_t type;
+    };
+    uint32_t mConnectorIds[OUTPUT_MAX];
+    Vector<DrmEncoder> mEncoders;
+    Vector<uint32_t> mCrtcIds;
+    bool mTopologyValid;
+
+    enum {
+        IOCTL_COMMAND_COUNT = DRM_COMMAND_END - DRM_COMMAND_BASE,
+        // bucket 0 is below 16us, each next one doubles, the last one is
+        // 16ms and above
+        IOCTL_BUCKET_COUNT = 12,
+        IOCTL_FIRST_BUCKET_SHIFT = 4,
+    };
+
+    // updated with atomics from any thread calling into the driver
+    struct IoctlStats {
+        volatile int32_t count;
+        volatile int32_t failures;
+        volatile int32_t maxUs;
+        volatile int32_t buckets[IOCTL_BUCKET_COUNT];
+    } mIoctlStats[IOCTL_COMMAND_COUNT];
+
     int mDrmFd;
     Mutex mLock;
+    // serializes probes, which run without mLock held
+    Mutex mProbeLock;
     bool mInitialized;
 };
 
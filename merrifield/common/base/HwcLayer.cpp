@@ -69,9 +69,16 @@ HwcLayer::HwcLayer(int index, hwc_layer_1_t *layer)
       mPriority(0),
       mTransform(0),
       mStaticCount(0),
-      mUpdated(false)
+      mUpdated(false),
+      mStats(0),
+      mActive(false),
+      mPremap(false),
+      mPremapIndex(0),
+      mInfoHandle(0),
+      mInfoKey(0)
 {
     memset(&mSourceCropf, 0, sizeof(mSourceCropf));
+    memset(mPremapped, 0, sizeof(mPremapped));
     memset(&mDisplayFrame, 0, sizeof(mDisplayFrame));
     memset(&mStride, 0, sizeof(mStride));
 
@@ -84,12 +91,6 @@ HwcLayer::HwcLayer(int index, hwc_layer_1_t *layer)
     if (property_get("debug.hwc.fps_trace.enable", prop, "0") > 0) {
         mTraceFps = atoi(prop);
     }
-    mLastHandle = NULL;
-
-    if (mTraceFps) {
-        // holding up to 6 seconds of samples at 60Hz
-        mFrames.setCapacity(6 * 60);
-    }
 #endif
 }
 
@@ -99,12 +100,10 @@ HwcLayer::~HwcLayer()
         WTRACE("HwcLayer is not cleaned up");
     }
 
+    LayerStats::release(mStats);
+    mStats = NULL;
     mLayer = NULL;
     mPlane = NULL;
-
-#ifdef HWC_TRACE_FPS
-    mFrames.clear();
-#endif
 }
 
 bool HwcLayer::attachPlane(DisplayPlane* plane, int device)
@@ -259,27 +258,9 @@ bool HwcLayer::update(hwc_layer_1_t *layer)
     mLayer = layer;
     setupAttributes();
 
-#ifdef HWC_TRACE_FPS
-    if (mTraceFps && mLayer && mLayer->compositionType != HWC_FRAMEBUFFER_TARGET ) {
-        // 1 second = 1000000000 nano seconds
-        uint64_t now = systemTime(CLOCK_MONOTONIC);
-        if (mLastHandle != mHandle) {
-            mLastHandle = mHandle;
-            mFrames.push(now);
-        }
-        // calculate fps in 5-second time window
-        int frames = mFrames.size();
-        while (frames && now - mFrames[0] > 5000000000LL) {
-            mFrames.removeItemsAt(0);
-            frames--;
-        }
-        double fps = 0;
-        if (frames > 1) {
-            fps = frames * 1000000000.0/ (now - mFrames[0]);
-        }
-        ITRACE("fps of layer %d is %.1f", mIndex, fps);
+    if (mPremap && !mPlane) {
+        premapHandle();
     }
-#endif
 
     // if not a FB layer & a plane was attached update plane's data buffer
     if (mPlane) {
@@ -314,6 +295,29 @@ bool HwcLayer::update(hwc_layer_1_t *layer)
     return true;
 }
 
+void HwcLayer::enablePremap()
+{
+    mPremap = true;
+    premapHandle();
+}
+
+void HwcLayer::premapHandle()
+{
+    if (!mHandle) {
+        return;
+    }
+    for (int i = 0; i < PREMAP_HISTORY; i++) {
+        if (mPremapped[i] == mHandle) {
+            return;
+        }
+    }
+    mPremapped[mPremapIndex] = mHandle;
+    mPremapIndex = (mPremapIndex + 1) % PREMAP_HISTORY;
+
+    // get it mapped in the background before a plane needs it
+    Hwcomposer::getInstance().getBufferManager()->premap(mHandle);
+}
+
 bool HwcLayer::isUpdated()
 {
     return mUpdated;
@@ -324,6 +328,30 @@ uint32_t HwcLayer::getStaticCount()
     return mStaticCount;
 }
 
+void HwcLayer::setStats(LayerStats *stats, nsecs_t now)
+{
+    mStats = stats;
+    mActive = mStats && mStats->isActive(now);
+    if (mActive) {
+        mPriority |= LAYER_PRIORITY_ACTIVE;
+    }
+}
+
+void HwcLayer::updateStats(nsecs_t now)
+{
+    if (!mStats) {
+        return;
+    }
+
+    mStats->onFrame(now, mHandle, mType);
+
+#ifdef HWC_TRACE_FPS
+    if (mTraceFps && mType != LAYER_FRAMEBUFFER_TARGET) {
+        ITRACE("fps of layer %d is %.1f", mIndex, mStats->getFps(now));
+    }
+#endif
+}
+
 void HwcLayer::postFlip()
 {
     mUpdated = false;
@@ -366,11 +394,6 @@ void HwcLayer::setupAttributes()
     mDisplayFrame = mLayer->displayFrame;
     mHandle = mLayer->handle;
 
-    if (mFormat != DataBuffer::FORMAT_INVALID) {
-        // other attributes have been set.
-        return;
-    }
-
     if (mLayer->handle == NULL) {
         VTRACE("invalid handle");
         return;
@@ -382,26 +405,44 @@ void HwcLayer::setupAttributes()
         return;
     }
 
-    DataBuffer *buffer = bm->lockDataBuffer(mLayer->handle);
-     if (!buffer) {
-         ETRACE("failed to get buffer");
-     } else {
-        mFormat = buffer->getFormat();
-        mWidth = buffer->getWidth();
-        mHeight = buffer->getHeight();
-        mStride = buffer->getStride();
-        mPriority = (mSourceCropf.right - mSourceCropf.left) * (mSourceCropf.bottom - mSourceCropf.top);
-        mPriority <<= LAYER_PRIORITY_SIZE_OFFSET;
-        mPriority |= mIndex;
-        GraphicBuffer *gBuffer = (GraphicBuffer*)buffer;
-        mUsage = gBuffer->getUsage();
-        mIsProtected = GraphicBuffer::isProtectedBuffer((GraphicBuffer*)buffer);
-        if (mIsProtected) {
-            mPriority |= LAYER_PRIORITY_PROTECTED;
-        } else if (PlaneCapabilities::isFormatSupported(DisplayPlane::PLANE_OVERLAY, this)) {
-            mPriority |= LAYER_PRIORITY_OVERLAY;
+    // attributes follow the buffer, for the same buffer again reading its
+    // key is all it takes
+    uint64_t key = bm->getBufferKey(mLayer->handle);
+    if (mFormat != DataBuffer::FORMAT_INVALID &&
+        mInfoHandle == mLayer->handle && mInfoKey == key) {
+        return;
+    }
+
+    const BufferInfo *info = mInfoCache.lookup(mLayer->handle, key);
+    if (!info) {
+        BufferInfo decoded;
+        if (!bm->getBufferInfo(mLayer->handle, decoded)) {
+            ETRACE("failed to get buffer");
+            return;
         }
-        bm->unlockDataBuffer(buffer);
+        info = &mInfoCache.add(decoded);
+    }
+
+    mInfoHandle = mLayer->handle;
+    mInfoKey = key;
+    mFormat = info->getFormat();
+    mWidth = info->getWidth();
+    mHeight = info->getHeight();
+    mStride = info->getStride();
+    mPriority = (mSourceCropf.right - mSourceCropf.left) * (mSourceCropf.bottom - mSourceCropf.top);
+    if (mPriority > LAYER_PRIORITY_SIZE_MAX)
+        mPriority = LAYER_PRIORITY_SIZE_MAX;
+    mPriority <<= LAYER_PRIORITY_SIZE_OFFSET;
+    mPriority |= mIndex;
+    mUsage = info->getUsage();
+    mIsProtected = info->isProtected();
+    if (mIsProtected) {
+        mPriority |= LAYER_PRIORITY_PROTECTED;
+    } else if (PlaneCapabilities::isFormatSupported(DisplayPlane::PLANE_OVERLAY, this)) {
+        mPriority |= LAYER_PRIORITY_OVERLAY;
+    }
+    if (mActive) {
+        mPriority |= LAYER_PRIORITY_ACTIVE;
     }
 }
 
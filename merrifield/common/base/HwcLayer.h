@@ -17,8 +17,9 @@
 #define HWC_LAYER_H
 
 #include <hardware/hwcomposer.h>
+#include <GraphicBuffer.h>
 #include <DisplayPlane.h>
-#include <utils/Vector.h>
+#include <LayerStats.h>
 
 //#define HWC_TRACE_FPS
 
@@ -55,7 +56,15 @@ public:
     enum {
         LAYER_PRIORITY_OVERLAY = 0x60000000UL,
         LAYER_PRIORITY_PROTECTED = 0x70000000UL,
+        // frequently updated content, keeping it off the frame buffer
+        // lets the GPU skip composition of the static layers
+        LAYER_PRIORITY_ACTIVE = 0x08000000UL,
         LAYER_PRIORITY_SIZE_OFFSET = 4,
+        LAYER_PRIORITY_SIZE_MAX = 0x7fffff,
+    };
+    enum {
+        // handles remembered as premapped, enough for a triple buffered queue
+        PREMAP_HISTORY = 4,
     };
 public:
     HwcLayer(int index, hwc_layer_1_t *layer);
@@ -88,15 +97,22 @@ public:
 
     bool update(hwc_layer_1_t *layer);
     void postFlip();
+    // premap buffers of a plane candidate as they are first seen
+    void enablePremap();
     bool isUpdated();
     uint32_t getStaticCount();
 
+    // history of the layer's buffer queue, may be NULL
+    void setStats(LayerStats *stats, nsecs_t now);
+    void updateStats(nsecs_t now);
+
 public:
     // temporary solution for plane assignment
     bool mPlaneCandidate;
 
 private:
     void setupAttributes();
+    void premapHandle();
 
 private:
     const int mIndex;
@@ -121,11 +137,22 @@ private:
     uint32_t mStaticCount;
     bool mUpdated;
 
+    LayerStats *mStats;
+    bool mActive;
+
+    bool mPremap;
+    buffer_handle_t mPremapped[PREMAP_HISTORY];
+    int mPremapIndex;
+
+    // attributes of the buffers the layer cycles through, and the buffer
+    // the current ones are from
+    BufferInfoCache<PREMAP_HISTORY> mInfoCache;
+    buffer_handle_t mInfoHandle;
+    uint64_t mInfoKey;
+
 #ifdef HWC_TRACE_FPS
     // for frame per second trace
     bool mTraceFps;
-    buffer_handle_t mLastHandle;
-    Vector<uint64_t>  mFrames;
 #endif
 };
 
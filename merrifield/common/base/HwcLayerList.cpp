@@ -25,7 +25,7 @@
 namespace android {
 namespace intel {
 
-HwcLayerList::HwcLayerList(hwc_display_contents_1_t *list, int disp)
+HwcLayerList::HwcLayerList(hwc_display_contents_1_t *list, int disp, bool deferPlanes)
     : mList(list),
       mLayerCount(0),
       mLayers(),
@@ -36,7 +36,9 @@ HwcLayerList::HwcLayerList(hwc_display_contents_1_t *list, int disp)
       mZOrderConfig(),
       mFrameBufferTarget(NULL),
       mDisplayIndex(disp),
-      mLayerSize(0)
+      mLayerSize(0),
+      mDeferPlanes(deferPlanes),
+      mPlanesDeferred(false)
 {
     initialize();
 }
@@ -180,21 +182,13 @@ bool HwcLayerList::checkCursorSupported(HwcLayer *hwcLayer)
         return false;
     }
 
-    BufferManager *bm = Hwcomposer::getInstance().getBufferManager();
-    if (bm) {
-        DataBuffer *buffer = bm->lockDataBuffer(hwcLayer->getHandle());
-        if (buffer) {
-            uint32_t w = buffer->getWidth();
-            uint32_t h = buffer->getHeight();
-
-            if ((w != 64 || h != 64) &&
-                (w != 128 || h != 128) &&
-                (w != 256 || h != 256)) {
-                bm->unlockDataBuffer(buffer);
-                return false;
-            }
-        }
-        bm->unlockDataBuffer(buffer);
+    // the layer has read the buffer size in update
+    uint32_t w = hwcLayer->getBufferWidth();
+    uint32_t h = hwcLayer->getBufferHeight();
+    if ((w != 64 || h != 64) &&
+        (w != 128 || h != 128) &&
+        (w != 256 || h != 256)) {
+        return false;
     }
 
     return true;
@@ -215,6 +209,7 @@ bool HwcLayerList::initialize()
     mCursorCandidates.setCapacity(mLayerCount);
     mZOrderConfig.setCapacity(mLayerCount);
     Hwcomposer& hwc = Hwcomposer::getInstance();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
 
     for (int i = 0; i < mLayerCount; i++) {
         hwc_layer_1_t *layer = &mList->hwLayers[i];
@@ -227,6 +222,10 @@ bool HwcLayerList::initialize()
             DEINIT_AND_RETURN_FALSE("failed to allocate hwc layer %d", i);
         }
 
+        // candidates are sorted by priority on insertion, the history must
+        // be in place before
+        hwcLayer->setStats(LayerStats::acquire(mDisplayIndex, layer->handle), now);
+
         if (layer->compositionType == HWC_FRAMEBUFFER_TARGET) {
             hwcLayer->setType(HwcLayer::LAYER_FRAMEBUFFER_TARGET);
             mFrameBufferTarget = hwcLayer;
@@ -242,6 +241,7 @@ bool HwcLayerList::initialize()
             // by default use GPU composition
             hwcLayer->setType(HwcLayer::LAYER_FB);
             mFBLayers.add(hwcLayer);
+            bool candidate = true;
             if (checkCursorSupported(hwcLayer)) {
                 mCursorCandidates.add(hwcLayer);
             } else if (checkSupported(DisplayPlane::PLANE_SPRITE, hwcLayer)) {
@@ -251,6 +251,10 @@ bool HwcLayerList::initialize()
                 mOverlayCandidates.add(hwcLayer);
             } else {
                 // noncandidate layer
+                candidate = false;
+            }
+            if (candidate) {
+                hwcLayer->enablePremap();
             }
         } else if (layer->compositionType == HWC_SIDEBAND){
             hwcLayer->setType(HwcLayer::LAYER_SIDEBAND);
@@ -276,6 +280,11 @@ bool HwcLayerList::initialize()
         return true;
     }
 
+    if (mDeferPlanes) {
+        mPlanesDeferred = true;
+        return true;
+    }
+
     allocatePlanes();
 
     //dump();
@@ -307,10 +316,23 @@ void HwcLayerList::deinitialize()
     mCursorCandidates.clear();
     mZOrderConfig.clear();
     mFrameBufferTarget = NULL;
+    mPlanesDeferred = false;
     mLayerCount = 0;
 }
 
 
+bool HwcLayerList::allocateDeferredPlanes()
+{
+    // lists rebuilt from now on allocate planes right away
+    mDeferPlanes = false;
+    if (!mPlanesDeferred) {
+        return true;
+    }
+
+    mPlanesDeferred = false;
+    return allocatePlanes();
+}
+
 bool HwcLayerList::allocatePlanes()
 {
     return assignCursorPlanes();
@@ -973,9 +995,11 @@ DisplayPlane* HwcLayerList::getPlane(uint32_t index) const
 
 void HwcLayerList::postFlip()
 {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
     for (size_t i = 0; i < mLayers.size(); i++) {
         HwcLayer *hwcLayer = mLayers.itemAt(i);
         hwcLayer->postFlip();
+        hwcLayer->updateStats(now);
     }
 }
 
@@ -30,7 +30,9 @@ namespace intel {
 
 class HwcLayerList {
 public:
-    HwcLayerList(hwc_display_contents_1_t *list, int disp);
+    // with deferPlanes, plane allocation is left to allocateDeferredPlanes()
+    // so that the list can be built concurrently with other displays
+    HwcLayerList(hwc_display_contents_1_t *list, int disp, bool deferPlanes = false);
     virtual ~HwcLayerList();
 
 public:
@@ -39,6 +41,7 @@ public:
 
     virtual bool update(hwc_display_contents_1_t *list);
     virtual DisplayPlane* getPlane(uint32_t index) const;
+    bool allocateDeferredPlanes();
 
     void postFlip();
 
@@ -103,6 +106,8 @@ private:
     HwcLayer *mFrameBufferTarget;
     int mDisplayIndex;
     int mLayerSize;
+    bool mDeferPlanes;
+    bool mPlanesDeferred;
 };
 
 } // namespace intel
@@ -16,6 +16,9 @@
 #include <HwcTrace.h>
 #include <Hwcomposer.h>
 #include <Dump.h>
+#include <MemoryAccounting.h>
+#include <FrameTimings.h>
+#include <LayerStats.h>
 #include <UeventObserver.h>
 
 namespace android {
@@ -31,6 +34,8 @@ Hwcomposer::Hwcomposer(IPlatFactory *factory)
       mDisplayAnalyzer(0),
       mMultiDisplayObserver(0),
       mUeventObserver(0),
+      mEventLoop(0),
+      mWorkerLoop(0),
       mPlaneManager(0),
       mBufferManager(0),
       mDisplayContext(0),
@@ -40,6 +45,7 @@ Hwcomposer::Hwcomposer(IPlatFactory *factory)
 
     mDisplayDevices.setCapacity(IDisplayDevice::DEVICE_COUNT);
     mDisplayDevices.clear();
+    memset(mPrepareWorkers, 0, sizeof(mPrepareWorkers));
 }
 
 Hwcomposer::~Hwcomposer()
@@ -59,16 +65,26 @@ bool Hwcomposer::prepare(size_t numDisplays,
     bool ret = true;
 
     RETURN_FALSE_IF_NOT_INIT();
-    ATRACE("display count = %d", numDisplays);
+    HTRACE_SCOPE(PREPARE, numDisplays);
 
     if (!numDisplays || !displays) {
         ETRACE("invalid parameters");
         return false;
     }
 
+    FrameTimings::beginFrame();
+    StageTimer prepareTimer(FrameTimings::STAGE_PREPARE);
+
+    // planes are about to be updated, the last frame must be posted; a
+    // driver stall of more than a frame therefore blocks here
+    mDisplayContext->waitForPost();
+
+    StageTimer analyzeTimer(FrameTimings::STAGE_ANALYZE);
     mDisplayAnalyzer->analyzeContents(numDisplays, displays);
+    analyzeTimer.stop();
 
     // disable reclaimed planes
+    StageTimer reclaimTimer(FrameTimings::STAGE_RECLAIM);
     mPlaneManager->disableReclaimedPlanes();
 
         if(numDisplays > mDisplayDevices.size())
@@ -87,7 +103,14 @@ bool Hwcomposer::prepare(size_t numDisplays,
 
         device->prePrepare(displays[i]);
     }
+    reclaimTimer.stop();
 
+    StageTimer buildTimer(FrameTimings::STAGE_BUILD_LAYERS);
+    prepareLayers(numDisplays, displays);
+    buildTimer.stop();
+
+    StageTimer assignTimer(FrameTimings::STAGE_ASSIGN_PLANES);
+    // plane allocation in device order keeps it reproducible
     for (size_t i = 0; i < numDisplays; i++) {
         IDisplayDevice *device = mDisplayDevices.itemAt(i);
         if (!device) {
@@ -108,13 +131,58 @@ bool Hwcomposer::prepare(size_t numDisplays,
     return ret;
 }
 
+void Hwcomposer::prepareLayers(size_t numDisplays,
+                               hwc_display_contents_1_t** displays)
+{
+    IDisplayDevice *devices[IDisplayDevice::DEVICE_COUNT];
+    hwc_display_contents_1_t *contents[IDisplayDevice::DEVICE_COUNT];
+    size_t count = 0;
+
+    // only displays with a new geometry have layer lists to build
+    for (size_t i = 0; i < numDisplays; i++) {
+        IDisplayDevice *device = mDisplayDevices.itemAt(i);
+        if (!device || device->getType() == IDisplayDevice::DEVICE_VIRTUAL)
+            continue;
+        if (!displays[i] || !(displays[i]->flags & HWC_GEOMETRY_CHANGED))
+            continue;
+        devices[count] = device;
+        contents[count] = displays[i];
+        count++;
+    }
+
+    // hand all but the first display to the workers; prePrepare() has
+    // already deleted the old lists and reclaimed their planes in device
+    // order, building a list only reads buffer attributes and plane
+    // capabilities and takes locks of its own for layer stats and premap
+    size_t posted = 0;
+    for (size_t i = 1; i < count && posted < PREPARE_WORKER_COUNT; i++) {
+        if (!mPrepareWorkers[posted])
+            break;
+        mPrepareWorkers[posted++]->post(devices[i], contents[i]);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (i >= 1 && i <= posted)
+            continue;
+        if (!devices[i]->prepareLayers(contents[i])) {
+            ETRACE("failed to prepare layers for device %d", devices[i]->getType());
+        }
+    }
+
+    for (size_t i = 0; i < posted; i++) {
+        if (!mPrepareWorkers[i]->wait()) {
+            ETRACE("failed to prepare layers for device %d", devices[i + 1]->getType());
+        }
+    }
+}
+
 bool Hwcomposer::commit(size_t numDisplays,
                          hwc_display_contents_1_t **displays)
 {
     bool ret = true;
 
     RETURN_FALSE_IF_NOT_INIT();
-    ATRACE("display count = %d", numDisplays);
+    HTRACE_SCOPE(COMMIT, numDisplays);
 
     if (!numDisplays || !displays) {
         ETRACE("invalid parameters");
@@ -124,6 +192,8 @@ bool Hwcomposer::commit(size_t numDisplays,
         if(numDisplays > mDisplayDevices.size())
                 numDisplays = mDisplayDevices.size();
 
+    StageTimer commitTimer(FrameTimings::STAGE_COMMIT);
+    StageTimer flipTimer(FrameTimings::STAGE_FLIP);
     mDisplayContext->commitBegin(numDisplays, displays);
 
     for (size_t i = 0; i < numDisplays; i++) {
@@ -147,8 +217,10 @@ bool Hwcomposer::commit(size_t numDisplays,
             continue;
         }
     }
+    flipTimer.stop();
 
     mDisplayContext->commitEnd(numDisplays, displays);
+
     // return true always
     return true;
 }
@@ -173,6 +245,8 @@ bool Hwcomposer::setPowerMode(int disp, int mode)
         return false;
     }
 
+    // planes may be turned off, the last frame must be posted
+    mDisplayContext->waitForPost();
     return device->setPowerMode(mode);
 }
 
@@ -247,6 +321,8 @@ bool Hwcomposer::blank(int disp, int blank)
         return false;
     }
 
+    // planes may be turned off, the last frame must be posted
+    mDisplayContext->waitForPost();
     return device->blank(blank ? true : false);
 }
 
@@ -330,8 +406,15 @@ void Hwcomposer::vsync(int disp, int64_t timestamp)
 {
     RETURN_VOID_IF_NOT_INIT();
 
+    if (!mVsyncManager->onVsync(disp, timestamp)) {
+        HTRACE_INSTANT(VSYNC_DROPPED, disp);
+        return;
+    }
+
+    mBufferManager->onVsync();
+
     if (mProcs && mProcs->vsync) {
-        VTRACE("report vsync on disp %d, timestamp %llu", disp, timestamp);
+        HTRACE_INSTANT(VSYNC, disp);
         // workaround to pretend vsync is from primary display
         // Display will freeze if vsync is from external display.
         mProcs->vsync(const_cast<hwc_procs_t*>(mProcs), IDisplayDevice::DEVICE_PRIMARY, timestamp);
@@ -347,6 +430,7 @@ void Hwcomposer::hotplug(int disp, bool connected)
     mMultiDisplayObserver->notifyHotPlug(mDrm->isConnected(disp));
 
     if (mProcs && mProcs->hotplug) {
+        HTRACE_INSTANT(HOTPLUG, disp, connected);
         DTRACE("report hotplug on disp %d, connected %d", disp, connected);
         mProcs->hotplug(const_cast<hwc_procs_t*>(mProcs), disp, connected);
         DTRACE("hotplug callback processed and returned!");
@@ -360,7 +444,7 @@ void Hwcomposer::invalidate()
     RETURN_VOID_IF_NOT_INIT();
 
     if (mProcs && mProcs->invalidate) {
-        DTRACE("invalidating screen...");
+        HTRACE_INSTANT(INVALIDATE);
         mProcs->invalidate(const_cast<hwc_procs_t*>(mProcs));
     }
 }
@@ -387,14 +471,44 @@ bool Hwcomposer::dump(char *buff, int buff_len, int *cur_len)
             device->dump(d);
     }
 
+    // dump update history of all layers
+    LayerStats::dump(d);
+
+    // dump display analyzer state
+    if (mDisplayAnalyzer)
+        mDisplayAnalyzer->dump(d);
+
     // dump plane manager status
     if (mPlaneManager)
         mPlaneManager->dump(d);
 
+    // dump display context status
+    if (mDisplayContext)
+        mDisplayContext->dump(d);
+
+    // dump vsync manager status
+    if (mVsyncManager)
+        mVsyncManager->dump(d);
+
+    // dump driver call latencies
+    if (mDrm)
+        mDrm->dump(d);
+
+    // dump event loop handlers
+    if (mEventLoop)
+        mEventLoop->dump(d);
+    if (mWorkerLoop)
+        mWorkerLoop->dump(d);
+
     // dump buffer manager status
     if (mBufferManager)
         mBufferManager->dump(d);
 
+    // dump memory held by all allocators and caches
+    MemoryAccounting::dump(d);
+    FrameTimings::dump(d);
+    HwcTraceBuffer::dump(d);
+
     return true;
 }
 
@@ -412,6 +526,8 @@ bool Hwcomposer::initialize()
 {
     CTRACE();
 
+    HwcTraceBuffer::initialize();
+
     // create drm
     mDrm = new Drm();
     if (!mDrm || !mDrm->initialize()) {
@@ -439,6 +555,23 @@ bool Hwcomposer::initialize()
         DEINIT_AND_RETURN_FALSE("failed to create display context");
     }
 
+    mEventLoop = new EventLoop();
+    if (!mEventLoop || !mEventLoop->initialize("HwcEventLoop")) {
+        DEINIT_AND_RETURN_FALSE("failed to initialize event loop");
+    }
+
+    mWorkerLoop = new EventLoop();
+    if (!mWorkerLoop || !mWorkerLoop->initialize("HwcEventWorker")) {
+        DEINIT_AND_RETURN_FALSE("failed to initialize worker loop");
+    }
+
+    for (int i = 0; i < PREPARE_WORKER_COUNT; i++) {
+        mPrepareWorkers[i] = new PrepareWorker();
+        if (!mPrepareWorkers[i] || !mPrepareWorkers[i]->initialize(i)) {
+            DEINIT_AND_RETURN_FALSE("failed to initialize prepare worker %d", i);
+        }
+    }
+
     mUeventObserver = new UeventObserver();
     if (!mUeventObserver || !mUeventObserver->initialize()) {
         DEINIT_AND_RETURN_FALSE("failed to initialize uevent observer");
@@ -494,12 +627,22 @@ void Hwcomposer::deinitialize()
     }
     mDisplayDevices.clear();
 
+    for (int i = 0; i < PREPARE_WORKER_COUNT; i++) {
+        DEINIT_AND_DELETE_OBJ(mPrepareWorkers[i]);
+    }
+
+    // stops the commit thread and its fence handlers
+    DEINIT_AND_DELETE_OBJ(mDisplayContext);
+
+    // all handlers are removed by now
+    DEINIT_AND_DELETE_OBJ(mWorkerLoop);
+    DEINIT_AND_DELETE_OBJ(mEventLoop);
+
     if (mPlatFactory) {
         delete mPlatFactory;
         mPlatFactory = 0;
     }
 
-    DEINIT_AND_DELETE_OBJ(mDisplayContext);
     DEINIT_AND_DELETE_OBJ(mPlaneManager);
     DEINIT_AND_DELETE_OBJ(mBufferManager);
     DEINIT_AND_DELETE_OBJ(mDrm);
@@ -555,5 +698,15 @@ UeventObserver* Hwcomposer::getUeventObserver()
     return mUeventObserver;
 }
 
+EventLoop* Hwcomposer::getEventLoop()
+{
+    return mEventLoop;
+}
+
+EventLoop* Hwcomposer::getWorkerLoop()
+{
+    return mWorkerLoop;
+}
+
 } // namespace intel
 } // namespace android
@@ -0,0 +1,257 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <string.h>
+#include <HwcTrace.h>
+#include <utils/Mutex.h>
+#include <cutils/atomic.h>
+#include <HwcLayer.h>
+#include <LayerStats.h>
+
+namespace android {
+namespace intel {
+
+enum {
+    // composition types shown in the dump
+    TYPE_HISTORY_DUMP = 32,
+    // attempts to copy a history the composer keeps writing
+    DUMP_COPY_RETRIES = 8,
+};
+
+// a history not seen for this long no longer matches a handle, gralloc
+// may have handed its handles to another producer meanwhile
+static const nsecs_t HISTORY_TIMEOUT = 2000000000LL;
+static const nsecs_t FPS_WINDOW = 1000000000LL;
+
+// indexed by HwcLayer type
+static const char sTypeChars[] = "FfOSTBC";
+
+static Mutex sLock;
+static LayerStats sTable[LayerStats::TABLE_SIZE];
+
+LayerStats::LayerStats()
+    : mSequence(0),
+      mOwned(false)
+{
+    reset(0);
+}
+
+void LayerStats::reset(int disp)
+{
+    mDisp = disp;
+    mLastSeen = 0;
+    memset(mHandles, 0, sizeof(mHandles));
+    mHandleCount = 0;
+    mLastHandle = 0;
+    memset(mUpdates, 0, sizeof(mUpdates));
+    mUpdateCount = 0;
+    mFrameCount = 0;
+    mStaticStreak = 0;
+    mLongestStreak = 0;
+    memset(mTypes, 0, sizeof(mTypes));
+    mTypeChanges = 0;
+}
+
+bool LayerStats::hasHandle(buffer_handle_t handle) const
+{
+    for (int i = 0; i < QUEUE_HANDLES; i++) {
+        if (mHandles[i] == handle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+LayerStats* LayerStats::acquire(int disp, buffer_handle_t handle)
+{
+    Mutex::Autolock _l(sLock);
+
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    LayerStats *oldest = NULL;
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        LayerStats& stats = sTable[i];
+        if (stats.mOwned) {
+            continue;
+        }
+
+        if (handle && stats.mDisp == disp && stats.hasHandle(handle) &&
+            now - stats.mLastSeen < HISTORY_TIMEOUT) {
+            stats.mOwned = true;
+            return &stats;
+        }
+
+        if (!oldest || stats.mLastSeen < oldest->mLastSeen) {
+            oldest = &stats;
+        }
+    }
+
+    if (!oldest) {
+        VTRACE("no free layer history on device %d", disp);
+        return NULL;
+    }
+
+    oldest->reset(disp);
+    oldest->mOwned = true;
+    oldest->mLastSeen = now;
+    return oldest;
+}
+
+void LayerStats::release(LayerStats *stats)
+{
+    if (!stats) {
+        return;
+    }
+
+    Mutex::Autolock _l(sLock);
+    stats->mOwned = false;
+}
+
+void LayerStats::onFrame(nsecs_t now, buffer_handle_t handle, uint32_t type)
+{
+    int32_t sequence = mSequence;
+    android_atomic_release_store(sequence + 1, &mSequence);
+    android_memory_barrier();
+
+    mLastSeen = now;
+
+    if (handle && handle != mLastHandle) {
+        if (!hasHandle(handle)) {
+            mHandles[mHandleCount++ % QUEUE_HANDLES] = handle;
+        }
+        mUpdates[mUpdateCount++ & (UPDATE_RING_SIZE - 1)] = now;
+        mLastHandle = handle;
+        mStaticStreak = 0;
+    } else if (++mStaticStreak > mLongestStreak) {
+        mLongestStreak = mStaticStreak;
+    }
+
+    uint8_t last = mTypes[(mFrameCount - 1) & (TYPE_RING_SIZE - 1)];
+    if (mFrameCount && last != type) {
+        mTypeChanges++;
+    }
+    mTypes[mFrameCount++ & (TYPE_RING_SIZE - 1)] = uint8_t(type);
+
+    android_atomic_release_store(sequence + 2, &mSequence);
+}
+
+float LayerStats::getFps(nsecs_t now) const
+{
+    uint32_t count = mUpdateCount < (uint32_t)UPDATE_RING_SIZE ?
+            mUpdateCount : (uint32_t)UPDATE_RING_SIZE;
+    uint32_t updates = 0;
+    while (updates < count) {
+        nsecs_t t = mUpdates[(mUpdateCount - 1 - updates) & (UPDATE_RING_SIZE - 1)];
+        if (now - t >= FPS_WINDOW) {
+            break;
+        }
+        updates++;
+    }
+
+    if (updates < (uint32_t)UPDATE_RING_SIZE) {
+        return float(updates);
+    }
+
+    // more updates than the ring holds in a second
+    nsecs_t span = now - mUpdates[mUpdateCount & (UPDATE_RING_SIZE - 1)];
+    return span > 0 ? updates * 1000000000.0f / span : 0;
+}
+
+bool LayerStats::isActive(nsecs_t now) const
+{
+    return getFps(now) >= ACTIVE_FPS;
+}
+
+void LayerStats::dumpStats(Dump& d, nsecs_t now) const
+{
+    // sorted intervals between content updates
+    nsecs_t intervals[UPDATE_RING_SIZE];
+    uint32_t count = mUpdateCount < (uint32_t)UPDATE_RING_SIZE ?
+            mUpdateCount : (uint32_t)UPDATE_RING_SIZE;
+    int samples = 0;
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t n = mUpdateCount - count + i;
+        nsecs_t interval = mUpdates[n & (UPDATE_RING_SIZE - 1)] -
+                           mUpdates[(n - 1) & (UPDATE_RING_SIZE - 1)];
+        int j = samples++;
+        while (j > 0 && intervals[j - 1] > interval) {
+            intervals[j] = intervals[j - 1];
+            j--;
+        }
+        intervals[j] = interval;
+    }
+
+    nsecs_t median = samples ? intervals[samples / 2] : 0;
+    nsecs_t longest = samples ? intervals[samples - 1] : 0;
+    // updates which came in late compared to the usual cadence
+    int stalls = 0;
+    for (int i = samples - 1; i >= 0 && intervals[i] > median * 2; i--) {
+        stalls++;
+    }
+
+    char types[TYPE_HISTORY_DUMP + 1];
+    uint32_t typeCount = mFrameCount < (uint32_t)TYPE_HISTORY_DUMP ?
+            mFrameCount : (uint32_t)TYPE_HISTORY_DUMP;
+    for (uint32_t i = 0; i < typeCount; i++) {
+        uint8_t type = mTypes[(mFrameCount - typeCount + i) & (TYPE_RING_SIZE - 1)];
+        types[i] = type < sizeof(sTypeChars) - 1 ? sTypeChars[type] : '?';
+    }
+    types[typeCount] = 0;
+
+    d.append("  %2d  | 0x%08x | %7u | %5.1f | %6.1f | %6.1f | %6d | %5u (%5u) | %7u | %s%s\n",
+             mDisp, (uint32_t)(uintptr_t)mLastHandle, mFrameCount, getFps(now),
+             median / 1000000.0, longest / 1000000.0, stalls,
+             mStaticStreak, mLongestStreak, mTypeChanges, types,
+             mOwned ? "" : " (gone)");
+}
+
+void LayerStats::dump(Dump& d)
+{
+    Mutex::Autolock _l(sLock);
+
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    d.append("Layer stats (types oldest first: F fb, f forced fb, O overlay, S skipped,\n"
+             "             T fb target, B sideband, C cursor):\n");
+    d.append(" DISP |   HANDLE   |  FRAMES |   FPS | MED ms | MAX ms | STALLS | STATIC (MAX)  "
+             "| CHANGES | TYPES\n");
+    d.append("------+------------+---------+-------+--------+--------+--------+---------------"
+             "+---------+-------\n");
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        // take a consistent copy, the owner updates it without the lock
+        LayerStats stats;
+        bool copied = false;
+        for (int retry = 0; retry < DUMP_COPY_RETRIES && !copied; retry++) {
+            int32_t sequence = android_atomic_acquire_load(&sTable[i].mSequence);
+            if (sequence & 1) {
+                continue;
+            }
+            stats = sTable[i];
+            android_memory_barrier();
+            copied = android_atomic_acquire_load(&sTable[i].mSequence) == sequence;
+        }
+        if (!copied) {
+            d.append("  %2d  | history busy\n", sTable[i].mDisp);
+            continue;
+        }
+
+        if (!stats.mFrameCount ||
+            (!stats.mOwned && now - stats.mLastSeen >= HISTORY_TIMEOUT)) {
+            continue;
+        }
+        stats.dumpStats(d, now);
+    }
+}
+
+} // namespace intel
+} // namespace android
@@ -0,0 +1,92 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef LAYER_STATS_H
+#define LAYER_STATS_H
+
+#include <stdint.h>
+#include <hardware/hwcomposer.h>
+#include <utils/Timers.h>
+#include <Dump.h>
+
+namespace android {
+namespace intel {
+
+// Update history of the buffer queue behind a layer. HwcLayer objects
+// only live until the next geometry change, so the history is kept in a
+// process wide table and found again through the handles of the queue.
+// A history is written by the layer owning it on the composer thread;
+// the table itself is guarded for layer lists built on prepare workers.
+// The dump reads a history while it is written and copies it under a
+// sequence count so that it never prints a half updated frame.
+class LayerStats {
+public:
+    enum {
+        // must be powers of two
+        UPDATE_RING_SIZE = 64,
+        TYPE_RING_SIZE = 64,
+        // buffers a queue cycles through
+        QUEUE_HANDLES = 4,
+        TABLE_SIZE = 32,
+        // content rate at which a layer is worth a plane of its own
+        ACTIVE_FPS = 20,
+    };
+
+public:
+    LayerStats();
+
+public:
+    // history of the queue handle belongs to, or a new one, NULL if all
+    // histories are owned by other layers
+    static LayerStats* acquire(int disp, buffer_handle_t handle);
+    static void release(LayerStats *stats);
+    static void dump(Dump& d);
+
+public:
+    // once per committed frame with the layer's handle and HwcLayer type
+    void onFrame(nsecs_t now, buffer_handle_t handle, uint32_t type);
+    // content updates per second over the last second
+    float getFps(nsecs_t now) const;
+    bool isActive(nsecs_t now) const;
+    // frames since the last content update
+    uint32_t getStaticStreak() const { return mStaticStreak; }
+
+private:
+    void reset(int disp);
+    bool hasHandle(buffer_handle_t handle) const;
+    void dumpStats(Dump& d, nsecs_t now) const;
+
+private:
+    // odd while onFrame() is writing
+    volatile int32_t mSequence;
+    bool mOwned;
+    int mDisp;
+    nsecs_t mLastSeen;
+    buffer_handle_t mHandles[QUEUE_HANDLES];
+    uint32_t mHandleCount;
+    buffer_handle_t mLastHandle;
+    nsecs_t mUpdates[UPDATE_RING_SIZE];
+    uint32_t mUpdateCount;
+    uint32_t mFrameCount;
+    uint32_t mStaticStreak;
+    uint32_t mLongestStreak;
+    uint8_t mTypes[TYPE_RING_SIZE];
+    uint32_t mTypeChanges;
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* LAYER_STATS_H */
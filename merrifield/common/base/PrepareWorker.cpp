@@ -0,0 +1,122 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdio.h>
+#include <HwcTrace.h>
+#include <IDisplayDevice.h>
+#include <PrepareWorker.h>
+
+namespace android {
+namespace intel {
+
+PrepareWorker::PrepareWorker()
+    : mLock(),
+      mCondition(),
+      mDevice(0),
+      mDisplay(0),
+      mPending(false),
+      mResult(true),
+      mExitThread(false),
+      mInitialized(false)
+{
+}
+
+PrepareWorker::~PrepareWorker()
+{
+    WARN_IF_NOT_DEINIT();
+}
+
+bool PrepareWorker::initialize(int index)
+{
+    if (mInitialized) {
+        WTRACE("object has been initialized");
+        return true;
+    }
+
+    mExitThread = false;
+    mThread = new PrepareThread(this);
+    if (!mThread.get()) {
+        DEINIT_AND_RETURN_FALSE("failed to create prepare thread");
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "HwcPrepare%d", index);
+    mThread->run(name, PRIORITY_URGENT_DISPLAY);
+
+    mInitialized = true;
+    return true;
+}
+
+void PrepareWorker::deinitialize()
+{
+    if (mThread.get()) {
+        {
+            Mutex::Autolock _l(mLock);
+            mExitThread = true;
+            mCondition.broadcast();
+        }
+        mThread->requestExitAndWait();
+        mThread = NULL;
+    }
+
+    mPending = false;
+    mInitialized = false;
+}
+
+void PrepareWorker::post(IDisplayDevice *device, hwc_display_contents_1_t *display)
+{
+    Mutex::Autolock _l(mLock);
+    mDevice = device;
+    mDisplay = display;
+    mPending = true;
+    mCondition.broadcast();
+}
+
+bool PrepareWorker::wait()
+{
+    Mutex::Autolock _l(mLock);
+    while (mPending) {
+        mCondition.wait(mLock);
+    }
+    return mResult;
+}
+
+bool PrepareWorker::threadLoop()
+{
+    IDisplayDevice *device;
+    hwc_display_contents_1_t *display;
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mPending && !mExitThread) {
+            mCondition.wait(mLock);
+        }
+        if (mExitThread) {
+            return false;
+        }
+        device = mDevice;
+        display = mDisplay;
+    }
+
+    bool result = device->prepareLayers(display);
+
+    Mutex::Autolock _l(mLock);
+    mResult = result;
+    mPending = false;
+    mCondition.broadcast();
+    return true;
+}
+
+} // namespace intel
+} // namespace android
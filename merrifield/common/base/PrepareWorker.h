@@ -0,0 +1,60 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef PREPARE_WORKER_H
+#define PREPARE_WORKER_H
+
+#include <hardware/hwcomposer.h>
+#include <utils/threads.h>
+#include <SimpleThread.h>
+
+namespace android {
+namespace intel {
+
+class IDisplayDevice;
+
+// Runs the layer analysis of one display off the SurfaceFlinger thread
+// while the caller analyzes another one.
+class PrepareWorker {
+public:
+    PrepareWorker();
+    virtual ~PrepareWorker();
+
+public:
+    bool initialize(int index);
+    void deinitialize();
+    // calls device->prepareLayers(display) on the worker thread
+    void post(IDisplayDevice *device, hwc_display_contents_1_t *display);
+    // waits for the posted work to complete, returns its result
+    bool wait();
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    IDisplayDevice *mDevice;
+    hwc_display_contents_1_t *mDisplay;
+    bool mPending;
+    bool mResult;
+    bool mExitThread;
+    bool mInitialized;
+
+private:
+    DECLARE_THREAD(PrepareThread, PrepareWorker);
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* PREPARE_WORKER_H */
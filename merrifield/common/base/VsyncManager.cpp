@@ -21,6 +21,8 @@
 #include <DisplayPlaneManager.h>
 #include <Hwcomposer.h>
 #include <VsyncManager.h>
+#include <SoftVsyncObserver.h>
+#include <cutils/properties.h>
 
 
 namespace android {
@@ -32,8 +34,26 @@ VsyncManager::VsyncManager(Hwcomposer &hwc)
       mEnableDynamicVsync(true),
       mEnabled(false),
       mVsyncSource(IDisplayDevice::DEVICE_COUNT),
-      mLock()
+      mLock(),
+      mUseVsyncModel(false),
+      mVsyncModel(),
+      mHwVsyncOn(false),
+      mLockedVsyncs(0),
+      mModelVsyncs(0),
+      mModelSwitches(0),
+      mPendingSource(IDisplayDevice::DEVICE_COUNT),
+      mHandoverVsyncs(0),
+      mHandovers(0),
+      mPendingVsync(0),
+      mPendingPeriod(0),
+      mHandoverGate(0),
+      mLastVsync(0),
+      mLastVsyncSource(IDisplayDevice::DEVICE_COUNT),
+      mVsyncPeriod(0)
 {
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        mSoftVsync[i] = NULL;
+    }
 }
 
 VsyncManager::~VsyncManager()
@@ -47,6 +67,28 @@ bool VsyncManager::initialize()
     mEnabled = false;
     mVsyncSource = IDisplayDevice::DEVICE_COUNT;
     mEnableDynamicVsync = !scUsePrimaryVsyncOnly;
+
+    char prop[PROPERTY_VALUE_MAX];
+    mUseVsyncModel = true;
+    if (property_get("hwc.vsync.model.enable", prop, "1") > 0) {
+        mUseVsyncModel = atoi(prop) ? true : false;
+    }
+
+    if (mUseVsyncModel) {
+        // soft vsync to stand in for hardware vsync of physical displays
+        for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+            IDisplayDevice *device = getDisplayDevice(i);
+            if (!device) {
+                continue;
+            }
+            mSoftVsync[i] = new SoftVsyncObserver(*device);
+            if (!mSoftVsync[i] || !mSoftVsync[i]->initialize()) {
+                DEINIT_AND_RETURN_FALSE("failed to create soft vsync observer");
+            }
+            mSoftVsync[i]->setVsyncModel(&mVsyncModel);
+        }
+    }
+
     mInitialized = true;
     return true;
 }
@@ -57,6 +99,11 @@ void VsyncManager::deinitialize()
         WTRACE("vsync is still enabled");
     }
 
+    // not holding mLock, soft vsync threads may be waiting for it
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        DEINIT_AND_DELETE_OBJ(mSoftVsync[i]);
+    }
+
     mVsyncSource = IDisplayDevice::DEVICE_COUNT;
     mEnabled = false;
     mEnableDynamicVsync = !scUsePrimaryVsyncOnly;
@@ -102,13 +149,7 @@ void VsyncManager::resetVsyncSource()
         return;
     }
 
-    int vsyncSource = getCandidate();
-    if (vsyncSource == mVsyncSource) {
-        return;
-    }
-
-    disableVsync();
-    enableVsync(vsyncSource);
+    switchVsyncSource(getCandidate());
 }
 
 int VsyncManager::getVsyncSource()
@@ -130,13 +171,249 @@ void VsyncManager::enableDynamicVsync(bool enable)
         return;
     }
 
-    int vsyncSource = getCandidate();
-    if (vsyncSource == mVsyncSource) {
+    switchVsyncSource(getCandidate());
+}
+
+bool VsyncManager::onVsync(int disp, int64_t timestamp)
+{
+    Mutex::Autolock l(mLock);
+
+    if (!mEnabled) {
+        return true;
+    }
+
+    if (disp == mPendingSource) {
+        if (!completeHandover(timestamp)) {
+            // the old source has just reported this vsync
+            return false;
+        }
+    } else if (disp != mVsyncSource) {
+        // late event from a source which was switched off
+        return false;
+    } else if (timestamp < mHandoverGate) {
+        // the new source's copy of the last vsync of the old one
+        return false;
+    } else if (mPendingSource != IDisplayDevice::DEVICE_COUNT) {
+        if (++mHandoverVsyncs > HANDOVER_TIMEOUT_VSYNCS) {
+            WTRACE("no vsync from device %d, handover cancelled", mPendingSource);
+            cancelHandover();
+        } else {
+            checkHandover(timestamp);
+        }
+    }
+
+    if (mLastVsync && mLastVsyncSource == disp && timestamp > mLastVsync) {
+        mVsyncPeriod = timestamp - mLastVsync;
+    }
+    mLastVsync = timestamp;
+    mLastVsyncSource = disp;
+
+    // the last vsync of an old source does not belong to the new model
+    if (mUseVsyncModel && disp == mVsyncSource) {
+        updateVsyncModel(disp, timestamp);
+    }
+    return true;
+}
+
+int64_t VsyncManager::getNextVsync(int64_t after)
+{
+    Mutex::Autolock l(mLock);
+
+    int64_t next = mVsyncModel.getNextVsync(after);
+    if (next) {
+        return next;
+    }
+
+    if (!mLastVsync || !mVsyncPeriod) {
+        return 0;
+    }
+
+    // extrapolate from the last reported vsync, which may be old if
+    // vsync events are off
+    if (after < mLastVsync) {
+        return mLastVsync;
+    }
+    return mLastVsync + ((after - mLastVsync) / mVsyncPeriod + 1) * mVsyncPeriod;
+}
+
+void VsyncManager::updateVsyncModel(int disp, int64_t timestamp)
+{
+    if (disp >= IDisplayDevice::DEVICE_VIRTUAL || !mSoftVsync[disp]) {
+        return;
+    }
+
+    IDisplayDevice *device = getDisplayDevice(disp);
+    if (!device) {
         return;
     }
 
-    disableVsync();
-    enableVsync(vsyncSource);
+    if (mHwVsyncOn) {
+        mVsyncModel.addSample(timestamp);
+        if (!mVsyncModel.isLocked()) {
+            mLockedVsyncs = 0;
+            return;
+        }
+        if (++mLockedVsyncs < LOCKED_VSYNC_COUNT) {
+            return;
+        }
+
+        // model is locked, soft vsync takes over in phase
+        if (!device->vsyncControl(false)) {
+            WTRACE("failed to disable hardware vsync on device %d", disp);
+            mLockedVsyncs = 0;
+            return;
+        }
+        VTRACE("hardware vsync off, following model on device %d", disp);
+        mHwVsyncOn = false;
+        mModelVsyncs = 0;
+        mModelSwitches++;
+        mSoftVsync[disp]->control(true);
+    } else {
+        if (++mModelVsyncs < MODEL_VSYNC_COUNT) {
+            return;
+        }
+
+        // turn hardware vsync back on to correct the model for drift
+        mSoftVsync[disp]->control(false);
+        if (!device->vsyncControl(true)) {
+            WTRACE("failed to enable hardware vsync on device %d", disp);
+            mModelVsyncs = 0;
+            mSoftVsync[disp]->control(true);
+            return;
+        }
+        VTRACE("hardware vsync on to resync model on device %d", disp);
+        mHwVsyncOn = true;
+        mLockedVsyncs = 0;
+    }
+}
+
+void VsyncManager::switchVsyncSource(int candidate)
+{
+    if (mPendingSource != IDisplayDevice::DEVICE_COUNT) {
+        if (candidate == mPendingSource) {
+            return;
+        }
+        cancelHandover();
+    }
+
+    if (candidate == mVsyncSource) {
+        return;
+    }
+
+    // keep the current source running until the new one delivers
+    IDisplayDevice *device = getDisplayDevice(candidate);
+    if (mVsyncSource == IDisplayDevice::DEVICE_COUNT ||
+        !device || !device->vsyncControl(true)) {
+        WTRACE("vsync handover to device %d is not possible", candidate);
+        disableVsync();
+        enableVsync(candidate);
+        return;
+    }
+
+    VTRACE("handing vsync over from device %d to %d", mVsyncSource, candidate);
+    mPendingSource = candidate;
+    mHandoverVsyncs = 0;
+    mPendingVsync = 0;
+    mPendingPeriod = 0;
+}
+
+int64_t VsyncManager::getSourcePeriod()
+{
+    if (mVsyncModel.isLocked()) {
+        return mVsyncModel.getPeriod();
+    }
+    return mVsyncPeriod;
+}
+
+int64_t VsyncManager::getExpectedVsync()
+{
+    int64_t next = mVsyncModel.getNextVsync(mLastVsync);
+    if (next) {
+        return next;
+    }
+    return mLastVsync + mVsyncPeriod;
+}
+
+bool VsyncManager::completeHandover(int64_t timestamp)
+{
+    // the new source takes over at the predicted next vsync of the old
+    // one, an event before the middle of that slot duplicates the vsync
+    // reported last
+    int64_t period = getSourcePeriod();
+    if (mLastVsync && period && timestamp < getExpectedVsync() - period / 2) {
+        // keep its phase to find out which of its vsyncs takes over
+        if (mPendingVsync && timestamp > mPendingVsync) {
+            mPendingPeriod = timestamp - mPendingVsync;
+        }
+        mPendingVsync = timestamp;
+        return false;
+    }
+
+    finishHandover(0);
+    return true;
+}
+
+void VsyncManager::checkHandover(int64_t timestamp)
+{
+    // the new source trails the old one by less than half a period, its
+    // next vsync is the same slot as the one being reported, so this is
+    // the last vsync of the old source
+    int64_t period = mPendingPeriod ? mPendingPeriod : getSourcePeriod();
+    if (!mPendingVsync || !period) {
+        return;
+    }
+
+    int64_t next = mPendingVsync + period;
+    if (next < timestamp) {
+        next += ((timestamp - next) / period + 1) * period;
+    }
+
+    int64_t half = getSourcePeriod() / 2;
+    if (next < timestamp + half) {
+        finishHandover(timestamp + half);
+    }
+}
+
+void VsyncManager::finishHandover(int64_t gate)
+{
+    stopVsync(mVsyncSource);
+    mVsyncSource = mPendingSource;
+    mPendingSource = IDisplayDevice::DEVICE_COUNT;
+    mHandoverGate = gate;
+    mPendingVsync = 0;
+    mPendingPeriod = 0;
+
+    // a new source needs a new model
+    mVsyncModel.reset();
+    mLockedVsyncs = 0;
+    mModelVsyncs = 0;
+    mHandovers++;
+}
+
+void VsyncManager::cancelHandover()
+{
+    if (mPendingSource == IDisplayDevice::DEVICE_COUNT) {
+        return;
+    }
+
+    IDisplayDevice *device = getDisplayDevice(mPendingSource);
+    if (device && !device->vsyncControl(false)) {
+        WTRACE("failed to disable vsync on device %d", mPendingSource);
+    }
+    mPendingSource = IDisplayDevice::DEVICE_COUNT;
+}
+
+void VsyncManager::dump(Dump& d)
+{
+    Mutex::Autolock l(mLock);
+
+    d.append("Vsync Manager state:\n");
+    d.append("  source %d, enabled %d, hardware vsync %s, model switches %u\n",
+             mVsyncSource, mEnabled, mHwVsyncOn ? "on" : "off", mModelSwitches);
+    d.append("  pending source %d, handovers %u\n", mPendingSource, mHandovers);
+    if (mUseVsyncModel) {
+        mVsyncModel.dump(d);
+    }
 }
 
 IDisplayDevice* VsyncManager::getDisplayDevice(int dispType ) {
@@ -180,8 +457,15 @@ bool VsyncManager::enableVsync(int candidate)
         return false;
     }
 
+    // a new source needs a new model
+    mVsyncModel.reset();
+    mLockedVsyncs = 0;
+    mModelVsyncs = 0;
+    mLastVsync = 0;
+
     if (device->vsyncControl(true)) {
         mVsyncSource = candidate;
+        mHwVsyncOn = true;
         return true;
     }
 
@@ -190,6 +474,7 @@ bool VsyncManager::enableVsync(int candidate)
         device = getDisplayDevice(IDisplayDevice::DEVICE_PRIMARY);
         if (device && device->vsyncControl(true)) {
             mVsyncSource = IDisplayDevice::DEVICE_PRIMARY;
+            mHwVsyncOn = true;
             return true;
         }
     }
@@ -199,16 +484,30 @@ bool VsyncManager::enableVsync(int candidate)
 
 void VsyncManager::disableVsync()
 {
+    cancelHandover();
+
     if (mVsyncSource == IDisplayDevice::DEVICE_COUNT) {
         WTRACE("vsync has been disabled");
         return;
     }
 
-    IDisplayDevice *device = getDisplayDevice(mVsyncSource);
+    stopVsync(mVsyncSource);
+    mVsyncSource = IDisplayDevice::DEVICE_COUNT;
+}
+
+void VsyncManager::stopVsync(int disp)
+{
+    if (!mHwVsyncOn) {
+        // soft vsync is following the model
+        mSoftVsync[disp]->control(false);
+        mHwVsyncOn = true;
+        return;
+    }
+
+    IDisplayDevice *device = getDisplayDevice(disp);
     if (device && !device->vsyncControl(false)) {
-        WTRACE("failed to disable vsync on device %d", mVsyncSource);
+        WTRACE("failed to disable vsync on device %d", disp);
     }
-    mVsyncSource = IDisplayDevice::DEVICE_COUNT;
 }
 
 } // namespace intel
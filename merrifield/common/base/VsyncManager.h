@@ -17,6 +17,8 @@
 #define VSYNC_MANAGER_H
 
 #include <IDisplayDevice.h>
+#include <Dump.h>
+#include <VsyncModel.h>
 #include <utils/threads.h>
 
 namespace android {
@@ -24,6 +26,7 @@ namespace intel {
 
 
 class Hwcomposer;
+class SoftVsyncObserver;
 
 class VsyncManager {
 public:
@@ -37,11 +40,35 @@ public:
     void resetVsyncSource();
     int getVsyncSource();
     void enableDynamicVsync(bool enable);
+    // returns false if the vsync event must not be reported, as it
+    // comes from a source which is not or not yet in use
+    bool onVsync(int disp, int64_t timestamp);
+    // predicted time of the first vsync strictly after the given time,
+    // 0 if no vsync has been seen yet
+    int64_t getNextVsync(int64_t after);
+    void dump(Dump& d);
 
 private:
     inline int getCandidate();
     inline bool enableVsync(int candidate);
     inline void disableVsync();
+    inline void stopVsync(int disp);
+    void updateVsyncModel(int disp, int64_t timestamp);
+    // enable the candidate first, the current source is disabled once the
+    // candidate delivers a vsync which does not duplicate the last one
+    void switchVsyncSource(int candidate);
+    // period of the current source, from its model once locked
+    int64_t getSourcePeriod();
+    // predicted vsync of the current source after the last reported one
+    int64_t getExpectedVsync();
+    // called for vsyncs of the pending source, returns false if the
+    // event comes before the slot the handover is aligned to
+    bool completeHandover(int64_t timestamp);
+    // called for vsyncs of the current source during a handover
+    void checkHandover(int64_t timestamp);
+    // events of the new source before the gate are dropped
+    void finishHandover(int64_t gate);
+    void cancelHandover();
     IDisplayDevice* getDisplayDevice(int dispType);
 
 private:
@@ -52,6 +79,36 @@ private:
     int  mVsyncSource;
     Mutex mLock;
 
+    // hardware vsync is turned off while soft vsync follows the model
+    bool mUseVsyncModel;
+    VsyncModel mVsyncModel;
+    SoftVsyncObserver *mSoftVsync[IDisplayDevice::DEVICE_VIRTUAL];
+    bool mHwVsyncOn;
+    int mLockedVsyncs;
+    int mModelVsyncs;
+    uint32_t mModelSwitches;
+
+    // source being handed over to, DEVICE_COUNT if none
+    int mPendingSource;
+    int mHandoverVsyncs;
+    uint32_t mHandovers;
+    // last vsync of the pending source and its interval, for its phase
+    int64_t mPendingVsync;
+    int64_t mPendingPeriod;
+    int64_t mHandoverGate;
+    int64_t mLastVsync;
+    int mLastVsyncSource;
+    int64_t mVsyncPeriod;
+
+    enum {
+        // hardware vsyncs fitting the model before turning hardware off
+        LOCKED_VSYNC_COUNT = 8,
+        // soft vsyncs before hardware vsync is turned on to resync
+        MODEL_VSYNC_COUNT = 120,
+        // vsyncs of the current source to wait for the new source
+        HANDOVER_TIMEOUT_VSYNCS = 10,
+    };
+
 private:
     // toggle this constant to use primary vsync only or enable dynamic vsync.
     static const bool scUsePrimaryVsyncOnly = false;
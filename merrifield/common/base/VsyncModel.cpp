@@ -0,0 +1,199 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <math.h>
+#include <HwcTrace.h>
+#include <VsyncModel.h>
+
+namespace android {
+namespace intel {
+
+VsyncModel::VsyncModel()
+    : mLock(),
+      mSampleCount(0),
+      mNewest(0),
+      mPeriod(0),
+      mPhase(0),
+      mError(0),
+      mLocked(false),
+      mOutliers(0),
+      mTotalOutliers(0),
+      mResets(0)
+{
+    memset(mSamples, 0, sizeof(mSamples));
+}
+
+VsyncModel::~VsyncModel()
+{
+}
+
+void VsyncModel::reset()
+{
+    Mutex::Autolock _l(mLock);
+    resetLocked();
+}
+
+void VsyncModel::resetLocked()
+{
+    mSampleCount = 0;
+    mNewest = 0;
+    mPeriod = 0;
+    mPhase = 0;
+    mError = 0;
+    mLocked = false;
+    mOutliers = 0;
+}
+
+bool VsyncModel::addSample(nsecs_t timestamp)
+{
+    Mutex::Autolock _l(mLock);
+
+    if (mSampleCount) {
+        nsecs_t interval = timestamp - mSamples[mNewest];
+        if (interval <= 0) {
+            VTRACE("out of order vsync timestamp %lld", timestamp);
+            return false;
+        }
+
+        if (mLocked) {
+            double offset = double(timestamp - mPhase);
+            double error = offset - floor(offset / mPeriod + 0.5) * mPeriod;
+            if (fabs(error) > mPeriod / OUTLIER_RATIO) {
+                mTotalOutliers++;
+                if (++mOutliers < MAX_OUTLIERS) {
+                    VTRACE("rejected vsync %lld, off by %.0fns", timestamp, error);
+                    return false;
+                }
+                // the source does not follow the model any more
+                DTRACE("vsync model lost lock, period %.0fns", mPeriod);
+                mResets++;
+                resetLocked();
+            } else {
+                mOutliers = 0;
+            }
+        } else if (interval > MAX_PERIOD * 2) {
+            // samples are too far apart to be counted, start over
+            resetLocked();
+        }
+    }
+
+    mNewest = mSampleCount ? (mNewest + 1) % MAX_SAMPLES : 0;
+    mSamples[mNewest] = timestamp;
+    if (mSampleCount < MAX_SAMPLES) {
+        mSampleCount++;
+    }
+
+    if (mSampleCount >= MIN_SAMPLES) {
+        fitLocked();
+    }
+    return true;
+}
+
+void VsyncModel::fitLocked()
+{
+    const nsecs_t newest = mSamples[mNewest];
+    double period = mPeriod;
+
+    if (period <= 0) {
+        // seed the period with the shortest interval, missed vsyncs only
+        // make intervals longer
+        nsecs_t shortest = MAX_PERIOD * 2;
+        for (int i = 1; i < mSampleCount; i++) {
+            int cur = (mNewest - i + 1 + MAX_SAMPLES) % MAX_SAMPLES;
+            int prev = (mNewest - i + MAX_SAMPLES) % MAX_SAMPLES;
+            nsecs_t interval = mSamples[cur] - mSamples[prev];
+            if (interval < shortest) {
+                shortest = interval;
+            }
+        }
+        if (shortest < MIN_PERIOD || shortest > MAX_PERIOD) {
+            VTRACE("implausible vsync interval %lld", shortest);
+            return;
+        }
+        period = double(shortest);
+    }
+
+    // least squares of timestamp over vsync count, relative to the
+    // newest sample to keep precision
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    const int n = mSampleCount;
+    for (int i = 0; i < n; i++) {
+        int index = (mNewest - i + MAX_SAMPLES) % MAX_SAMPLES;
+        double y = double(mSamples[index] - newest);
+        double x = floor(y / period + 0.5);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    double det = n * sxx - sx * sx;
+    if (det <= 0) {
+        return;
+    }
+    double slope = (n * sxy - sx * sy) / det;
+    double intercept = (sy - slope * sx) / n;
+    if (slope < MIN_PERIOD || slope > MAX_PERIOD) {
+        VTRACE("implausible vsync period %.0f", slope);
+        return;
+    }
+
+    double error = 0;
+    for (int i = 0; i < n; i++) {
+        int index = (mNewest - i + MAX_SAMPLES) % MAX_SAMPLES;
+        double y = double(mSamples[index] - newest);
+        double residual = y - (floor(y / slope + 0.5) * slope + intercept);
+        error += residual * residual;
+    }
+
+    mPeriod = slope;
+    mPhase = newest + nsecs_t(intercept);
+    mError = sqrt(error / n);
+    mLocked = mError < mPeriod / LOCK_RATIO;
+}
+
+bool VsyncModel::isLocked() const
+{
+    Mutex::Autolock _l(mLock);
+    return mLocked;
+}
+
+nsecs_t VsyncModel::getPeriod() const
+{
+    Mutex::Autolock _l(mLock);
+    return nsecs_t(mPeriod);
+}
+
+nsecs_t VsyncModel::getNextVsync(nsecs_t after) const
+{
+    Mutex::Autolock _l(mLock);
+    if (!mLocked) {
+        return 0;
+    }
+
+    double count = floor(double(after - mPhase) / mPeriod) + 1;
+    return mPhase + nsecs_t(count * mPeriod);
+}
+
+void VsyncModel::dump(Dump& d)
+{
+    Mutex::Autolock _l(mLock);
+    d.append("  vsync model: %s, period %.0fns, phase %lld, rms error %.0fns\n",
+             mLocked ? "locked" : "unlocked", mPeriod, mPhase, mError);
+    d.append("  samples %d, outliers %u, resets %u\n",
+             mSampleCount, mTotalOutliers, mResets);
+}
+
+} // namespace intel
+} // namespace android
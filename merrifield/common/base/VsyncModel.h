@@ -0,0 +1,82 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef VSYNC_MODEL_H
+#define VSYNC_MODEL_H
+
+#include <Dump.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace intel {
+
+// Period and phase of a vsync source, fitted by least squares over the
+// most recent hardware vsync timestamps. Samples which do not line up
+// with the model are rejected, and the model restarts from scratch if
+// the source stops fitting, e.g. after a refresh rate change.
+class VsyncModel {
+public:
+    VsyncModel();
+    ~VsyncModel();
+
+public:
+    void reset();
+    // returns false if the timestamp was rejected as an outlier
+    bool addSample(nsecs_t timestamp);
+    bool isLocked() const;
+    nsecs_t getPeriod() const;
+    // first modelled vsync strictly after the given time, 0 if not locked
+    nsecs_t getNextVsync(nsecs_t after) const;
+    void dump(Dump& d);
+
+private:
+    void resetLocked();
+    void fitLocked();
+
+private:
+    enum {
+        MAX_SAMPLES = 32,
+        MIN_SAMPLES = 6,
+        // consecutive outliers after which the model is dropped
+        MAX_OUTLIERS = 4,
+        // samples further than period / OUTLIER_RATIO from the model
+        // are outliers
+        OUTLIER_RATIO = 8,
+        // the fit is locked if its rms error is below period / LOCK_RATIO
+        LOCK_RATIO = 20,
+    };
+
+    // plausible vsync periods, 20 Hz to 200 Hz
+    static const nsecs_t MIN_PERIOD = 5000000;
+    static const nsecs_t MAX_PERIOD = 50000000;
+
+    mutable Mutex mLock;
+    nsecs_t mSamples[MAX_SAMPLES];
+    int mSampleCount;
+    int mNewest;
+    double mPeriod;
+    nsecs_t mPhase;
+    double mError;
+    bool mLocked;
+    int mOutliers;
+    uint32_t mTotalOutliers;
+    uint32_t mResets;
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* VSYNC_MODEL_H */
@@ -19,78 +19,179 @@
 namespace android {
 namespace intel {
 
+// keep the table at most 3/4 full
+#define MAX_LOAD_NUMERATOR 3
+#define MAX_LOAD_DENOMINATOR 4
+
 BufferCache::BufferCache(int size)
+    : mTable(NULL),
+      mMask(0),
+      mCount(0)
 {
-    mBufferPool.setCapacity(size);
+    // twice the expected number of mappers, rounded up to a power of two
+    size_t capacity = 8;
+    while (capacity < (size_t)size * 2) {
+        capacity <<= 1;
+    }
+    if (!resize(capacity)) {
+        ETRACE("failed to allocate buffer cache");
+    }
 }
 
 BufferCache::~BufferCache()
 {
-    if (mBufferPool.size() != 0) {
+    if (mCount != 0) {
         ETRACE("buffer cache is not empty");
     }
-    mBufferPool.clear();
+    delete[] mTable;
+}
+
+size_t BufferCache::hash(uint64_t key)
+{
+    // 64-bit finalizer from MurmurHash3, buffer keys are often sequential
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+ssize_t BufferCache::findSlot(uint64_t key) const
+{
+    if (!mTable) {
+        return -1;
+    }
+
+    for (size_t i = hash(key) & mMask; mTable[i].mapper; i = (i + 1) & mMask) {
+        if (mTable[i].key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void BufferCache::insert(uint64_t key, BufferMapper *mapper)
+{
+    size_t i = hash(key) & mMask;
+    while (mTable[i].mapper) {
+        i = (i + 1) & mMask;
+    }
+    mTable[i].key = key;
+    mTable[i].mapper = mapper;
+    mCount++;
+}
+
+bool BufferCache::resize(size_t capacity)
+{
+    Entry *table = new Entry[capacity]();
+    if (!table) {
+        return false;
+    }
+
+    Entry *oldTable = mTable;
+    size_t oldCapacity = oldTable ? mMask + 1 : 0;
+    mTable = table;
+    mMask = capacity - 1;
+    mCount = 0;
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldTable[i].mapper) {
+            insert(oldTable[i].key, oldTable[i].mapper);
+        }
+    }
+    delete[] oldTable;
+    return true;
 }
 
 bool BufferCache::addMapper(uint64_t handle, BufferMapper* mapper)
 {
-    ssize_t index = mBufferPool.indexOfKey(handle);
-    if (index >= 0) {
-        ETRACE("buffer %#llx exists", handle);
+    if (!mTable || !mapper) {
+        ETRACE("invalid mapper or cache");
         return false;
     }
 
-    // add mapper
-    index = mBufferPool.add(handle, mapper);
-    if (index < 0) {
-        ETRACE("failed to add mapper. err = %d", (int)index);
+    if (findSlot(handle) >= 0) {
+        ETRACE("buffer %#llx exists", handle);
         return false;
     }
 
+    // grow before the probe sequences get long
+    if ((mCount + 1) * MAX_LOAD_DENOMINATOR > (mMask + 1) * MAX_LOAD_NUMERATOR) {
+        VTRACE("growing buffer cache to %d", (mMask + 1) * 2);
+        if (!resize((mMask + 1) * 2)) {
+            ETRACE("failed to grow buffer cache");
+            return false;
+        }
+    }
+
+    insert(handle, mapper);
     return true;
 }
 
 bool BufferCache::removeMapper(BufferMapper* mapper)
 {
-    ssize_t index;
-
     if (!mapper) {
         ETRACE("invalid mapper");
         return false;
     }
 
-    index = mBufferPool.removeItem(mapper->getKey());
-    if (index < 0) {
-        WTRACE("failed to remove mapper. err = %d", (int)index);
+    ssize_t slot = findSlot(mapper->getKey());
+    if (slot < 0) {
+        WTRACE("failed to remove mapper. err = %d", (int)slot);
         return false;
     }
 
+    // backward shift deletion: move every following entry of the cluster
+    // that is allowed to live in the hole into it
+    size_t hole = slot;
+    size_t next = hole;
+    while (true) {
+        next = (next + 1) & mMask;
+        if (!mTable[next].mapper) {
+            break;
+        }
+        size_t home = hash(mTable[next].key) & mMask;
+        if (((next - home) & mMask) >= ((next - hole) & mMask)) {
+            mTable[hole] = mTable[next];
+            hole = next;
+        }
+    }
+    mTable[hole].key = 0;
+    mTable[hole].mapper = NULL;
+    mCount--;
     return true;
 }
 
 BufferMapper* BufferCache::getMapper(uint64_t handle)
 {
-    ssize_t index = mBufferPool.indexOfKey(handle);
-    if (index < 0) {
+    ssize_t slot = findSlot(handle);
+    if (slot < 0) {
         // don't add ETRACE here as this condition will happen frequently
         return 0;
     }
-    return mBufferPool.valueAt(index);
+    return mTable[slot].mapper;
 }
 
 size_t BufferCache::getCacheSize() const
 {
-    return mBufferPool.size();
+    return mCount;
 }
 
 BufferMapper* BufferCache::getMapper(uint32_t index)
 {
-    if (index >= mBufferPool.size()) {
+    if (index >= mCount) {
         ETRACE("invalid index");
         return 0;
     }
-    BufferMapper* mapper = mBufferPool.valueAt(index);
-    return mapper;
+
+    // only used for dumping and tear down, a linear walk is fine
+    for (size_t i = 0; i <= mMask; i++) {
+        if (mTable[i].mapper && index-- == 0) {
+            return mTable[i].mapper;
+        }
+    }
+    return 0;
 }
 
 } // namespace intel
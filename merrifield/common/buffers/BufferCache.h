@@ -23,6 +23,10 @@ namespace android {
 namespace intel {
 
 // Generic buffer cache
+// Open addressing hash table with linear probing keyed by the 64-bit
+// buffer key. Removal shifts following entries back instead of leaving
+// tombstones, so lookups stay short no matter how often mappers come
+// and go.
 class BufferCache {
 public:
     BufferCache(int size);
@@ -38,7 +42,18 @@ public:
     // get mapper with an index
     virtual BufferMapper* getMapper(uint32_t index);
 private:
-    KeyedVector<uint64_t, BufferMapper*> mBufferPool;
+    struct Entry {
+        uint64_t key;
+        BufferMapper *mapper;
+    };
+    static inline size_t hash(uint64_t key);
+    ssize_t findSlot(uint64_t key) const;
+    bool resize(size_t capacity);
+    void insert(uint64_t key, BufferMapper *mapper);
+private:
+    Entry *mTable;
+    size_t mMask;
+    size_t mCount;
 };
 
 }
@@ -16,6 +16,7 @@
 
 #include <HwcTrace.h>
 #include <hardware/hwcomposer.h>
+#include <cutils/atomic.h>
 #include <BufferManager.h>
 #include <DrmConfig.h>
 
@@ -29,6 +30,14 @@ BufferManager::BufferManager()
       mBufferPool(NULL),
       mDataBuffer(NULL),
       mDataBufferLock(),
+      mEpoch(0),
+      mPremapQueue(),
+      mExitThread(false),
+      mPremapRequests(0),
+      mPremapped(0),
+      mPremapDropped(0),
+      mSyncMaps(0),
+      mBusyWaits(0),
       mInitialized(false)
 {
     CTRACE();
@@ -73,6 +82,14 @@ bool BufferManager::initialize()
         DEINIT_AND_RETURN_FALSE("failed to create data buffer");
     }
 
+    // start the thread doing premapping and deferred unmapping
+    mExitThread = false;
+    mThread = new WorkerThread(this);
+    if (!mThread.get()) {
+        DEINIT_AND_RETURN_FALSE("failed to create worker thread");
+    }
+    mThread->run("BufferWorker", PRIORITY_URGENT_DISPLAY);
+
     mInitialized = true;
     return true;
 }
@@ -81,6 +98,23 @@ void BufferManager::deinitialize()
 {
     mInitialized = false;
 
+    if (mThread.get()) {
+        {
+            Mutex::Autolock _l(mLock);
+            mExitThread = true;
+            mWorkCondition.signal();
+        }
+        mThread->requestExitAndWait();
+        mThread = NULL;
+    }
+    // queued mappers were never mapped
+    for (size_t i = 0; i < mPremapQueue.size(); i++) {
+        delete mPremapQueue.itemAt(i);
+    }
+    mPremapQueue.clear();
+    // parked mappers are still in the pool and get unmapped below
+    mParkedMappers.clear();
+
     if (mBufferPool) {
         // unmap & delete all cached buffer mappers
         for (size_t i = 0; i < mBufferPool->getCacheSize(); i++) {
@@ -113,7 +147,11 @@ void BufferManager::deinitialize()
 
 void BufferManager::dump(Dump& d)
 {
-    d.append("Buffer Manager status: pool size %d\n", mBufferPool->getCacheSize());
+    d.append("Buffer Manager status: pool size %d, pending unmap %d, epoch %d\n",
+             mBufferPool->getCacheSize(), mParkedMappers.size(), mEpoch);
+    d.append("Premap: requests %u, mapped %u, dropped %u, synchronous maps %u,"
+             " waits for the worker %u\n",
+             mPremapRequests, mPremapped, mPremapDropped, mSyncMaps, mBusyWaits);
     d.append("-------------------------------------------------------------\n");
     for (uint32_t i = 0; i < mBufferPool->getCacheSize(); i++) {
         BufferMapper *mapper = mBufferPool->getMapper(i);
@@ -128,6 +166,16 @@ void BufferManager::dump(Dump& d)
     return;
 }
 
+bool BufferManager::getBufferInfo(buffer_handle_t handle, BufferInfo& info)
+{
+    if (!handle) {
+        return false;
+    }
+
+    // decoding only reads the handle, there is nothing to share or lock
+    return decodeBufferInfo(handle, info);
+}
+
 DataBuffer* BufferManager::lockDataBuffer(buffer_handle_t handle)
 {
     mDataBufferLock.lock();
@@ -152,19 +200,52 @@ void BufferManager::put(DataBuffer *buffer)
 
 BufferMapper* BufferManager::map(DataBuffer& buffer)
 {
-    bool ret;
     BufferMapper* mapper;
 
     CTRACE();
     Mutex::Autolock _l(mLock);
+    // the worker is mapping or unmapping this buffer, wait for it
+    while (mBusyMappers.indexOfKey(buffer.getKey()) >= 0) {
+        mBusyWaits++;
+        mBusyCondition.wait(mLock);
+    }
+
     //try to get mapper from pool
     mapper = mBufferPool->getMapper(buffer.getKey());
     if (mapper) {
         // increase mapper ref count
-        mapper->incRef();
+        if (mapper->incRef() == 1) {
+            // still mapped as unmapping was deferred, reuse it
+            mParkedMappers.removeItem(mapper);
+        }
         return mapper;
     }
 
+    // a queued premap is too late now, mapped here it never gets mapped twice
+    for (size_t i = 0; i < mPremapQueue.size(); i++) {
+        if (mPremapQueue.itemAt(i)->getKey() == buffer.getKey()) {
+            delete mPremapQueue.itemAt(i);
+            mPremapQueue.removeAt(i);
+            mPremapDropped++;
+            break;
+        }
+    }
+
+    // not premapped, map it synchronously
+    mSyncMaps++;
+    mapper = createMapperLocked(buffer);
+    if (mapper) {
+        // increase mapper ref count
+        mapper->incRef();
+    }
+    return mapper;
+}
+
+BufferMapper* BufferManager::createMapperLocked(DataBuffer& buffer)
+{
+    bool ret;
+    BufferMapper* mapper;
+
     // create a new buffer mapper and add it to pool
     do {
         VTRACE("new buffer, will add it");
@@ -185,8 +266,6 @@ BufferMapper* BufferManager::map(DataBuffer& buffer)
             ETRACE("failed to add mapper");
             break;
         }
-        // increase mapper ref count
-        mapper->incRef();
         return mapper;
     } while (0);
 
@@ -206,16 +285,186 @@ void BufferManager::unmap(BufferMapper *mapper)
         return;
     }
 
-    // unmap & remove this mapper from buffer when refCount = 0
+    // park this mapper when refCount = 0, it is unmapped by the reclaim
+    // thread unless it gets mapped again within a few vsyncs
     int refCount = mapper->decRef();
     if (refCount < 0) {
         ETRACE("invalid ref count");
     } else if (!refCount) {
-        // remove mapper from buffer pool
-        mBufferPool->removeMapper(mapper);
+        mParkedMappers.add(mapper, mEpoch);
+    }
+}
+
+void BufferManager::onVsync()
+{
+    int32_t epoch = android_atomic_inc(&mEpoch) + 1;
+    if (epoch % RECLAIM_INTERVAL == 0) {
+        mWorkCondition.signal();
+    }
+}
+
+void BufferManager::premap(buffer_handle_t handle)
+{
+    RETURN_VOID_IF_NOT_INIT();
+
+    BufferInfo info;
+    if (!getBufferInfo(handle, info)) {
+        return;
+    }
+
+    {
+        Mutex::Autolock _l(mLock);
+        if (mBufferPool->getMapper(info.getKey())) {
+            // already mapped
+            return;
+        }
+        for (size_t i = 0; i < mPremapQueue.size(); i++) {
+            if (mPremapQueue.itemAt(i)->getKey() == info.getKey()) {
+                return;
+            }
+        }
+        if (mPremapQueue.size() >= MAX_PREMAP_COUNT) {
+            mPremapDropped++;
+            return;
+        }
+    }
+
+    // the mapper holds its own copy of the handle, so the caller's
+    // handle is not needed once this returns
+    DataBuffer *buffer = createDataBuffer(mGrallocModule, handle);
+    if (!buffer) {
+        ETRACE("failed to create data buffer");
+        return;
+    }
+    BufferMapper *mapper = createBufferMapper(mGrallocModule, *buffer);
+    delete buffer;
+    if (!mapper) {
+        ETRACE("failed to allocate mapper");
+        return;
+    }
+
+    Mutex::Autolock _l(mLock);
+    mPremapRequests++;
+    mPremapQueue.push(mapper);
+    mWorkCondition.signal();
+}
+
+void BufferManager::premapBuffer(BufferMapper *mapper)
+{
+    uint64_t key = mapper->getKey();
+    {
+        Mutex::Autolock _l(mLock);
+        if (mBufferPool->getMapper(key)) {
+            // mapped synchronously in the meantime
+            delete mapper;
+            return;
+        }
+        mBusyMappers.add(key, mapper);
+    }
+
+    // map outside of the lock so map() of other buffers is not blocked
+    // by the ioctls, a map() of this one waits for it
+    bool mapped = mapper->map();
+    if (!mapped) {
+        WTRACE("failed to premap buffer %#llx", key);
+    }
+
+    {
+        Mutex::Autolock _l(mLock);
+        mBusyMappers.removeItem(key);
+        mBusyCondition.broadcast();
+        if (mapped && mBufferPool->addMapper(key, mapper)) {
+            // park it until a plane maps it, it is unmapped if that never happens
+            mParkedMappers.add(mapper, mEpoch);
+            mPremapped++;
+            return;
+        }
+        mPremapDropped++;
+    }
+
+    // the pool is full, this is the only mapping of the buffer
+    if (mapped) {
         mapper->unmap();
-        delete mapper;
     }
+    delete mapper;
+}
+
+void BufferManager::reclaimMappers(bool all)
+{
+    Vector<BufferMapper*> deadMappers;
+
+    {
+        Mutex::Autolock _l(mLock);
+        int32_t epoch = mEpoch;
+        for (ssize_t i = mParkedMappers.size() - 1; i >= 0; i--) {
+            if (!all && epoch - mParkedMappers.valueAt(i) < DEFERRED_UNMAP_EPOCHS) {
+                continue;
+            }
+            BufferMapper *mapper = mParkedMappers.keyAt(i);
+            mBufferPool->removeMapper(mapper);
+            mParkedMappers.removeItemsAt(i);
+            mBusyMappers.add(mapper->getKey(), mapper);
+            deadMappers.push(mapper);
+        }
+    }
+
+    if (!deadMappers.size()) {
+        return;
+    }
+
+    // unmap outside of the lock so map() of other buffers is not blocked
+    // by the ioctls, a map() of these waits for them
+    for (size_t i = 0; i < deadMappers.size(); i++) {
+        deadMappers.itemAt(i)->unmap();
+    }
+
+    {
+        Mutex::Autolock _l(mLock);
+        for (size_t i = 0; i < deadMappers.size(); i++) {
+            mBusyMappers.removeItem(deadMappers.itemAt(i)->getKey());
+        }
+        mBusyCondition.broadcast();
+    }
+
+    for (size_t i = 0; i < deadMappers.size(); i++) {
+        delete deadMappers.itemAt(i);
+    }
+    VTRACE("unmapped %d buffers", deadMappers.size());
+}
+
+bool BufferManager::threadLoop()
+{
+    bool idle = false;
+    BufferMapper *mapper = NULL;
+    {
+        Mutex::Autolock _l(mLock);
+        if (mPremapQueue.isEmpty()) {
+            int32_t epoch = android_atomic_acquire_load(&mEpoch);
+            status_t err = mWorkCondition.waitRelative(mLock,
+                    milliseconds(RECLAIM_IDLE_TIMEOUT_MS));
+            // onVsync() signals without the lock so a wakeup can be missed,
+            // only a wait without any vsync means the display went idle
+            idle = (err == TIMED_OUT) &&
+                   android_atomic_acquire_load(&mEpoch) == epoch;
+        }
+        if (mExitThread) {
+            ITRACE("exiting thread loop");
+            return false;
+        }
+        if (!mPremapQueue.isEmpty()) {
+            mapper = mPremapQueue.itemAt(0);
+            mPremapQueue.removeAt(0);
+        }
+    }
+
+    // premapping is on the way to the next commit, it goes first
+    if (mapper) {
+        premapBuffer(mapper);
+        return true;
+    }
+
+    reclaimMappers(idle);
+    return true;
 }
 
 buffer_handle_t BufferManager::allocFrameBuffer(int width, int height, int *stride)
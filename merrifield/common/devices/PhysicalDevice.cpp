@@ -66,14 +66,15 @@ void PhysicalDevice::onGeometryChanged(hwc_display_contents_1_t *list)
 
     ATRACE("disp = %d, layer number = %d", mType, list->numHwLayers);
 
-    // NOTE: should NOT be here
+    // the old list was deleted by prePrepare() on the calling thread,
+    // deleting it here would reclaim its planes from a prepare worker
     if (mLayerList) {
-        WTRACE("mLayerList exists");
-        DEINIT_AND_DELETE_OBJ(mLayerList);
+        ETRACE("mLayerList exists");
+        return;
     }
 
-    // create a new layer list
-    mLayerList = new HwcLayerList(list, mType);
+    // create a new layer list, planes are allocated in prepare()
+    mLayerList = new HwcLayerList(list, mType, true);
     if (!mLayerList) {
         WTRACE("failed to create layer list");
     }
@@ -99,7 +100,7 @@ bool PhysicalDevice::prePrepare(hwc_display_contents_1_t *display)
     return true;
 }
 
-bool PhysicalDevice::prepare(hwc_display_contents_1_t *display)
+bool PhysicalDevice::prepareLayers(hwc_display_contents_1_t *display)
 {
     RETURN_FALSE_IF_NOT_INIT();
     Mutex::Autolock _l(mLock);
@@ -109,15 +110,36 @@ bool PhysicalDevice::prepare(hwc_display_contents_1_t *display)
 
     // check if geometry is changed
     if (display->flags & HWC_GEOMETRY_CHANGED) {
+        HTRACE_SCOPE(BUILD_LAYERS, mType, display->numHwLayers);
         onGeometryChanged(display);
     }
+    return true;
+}
+
+bool PhysicalDevice::prepare(hwc_display_contents_1_t *display)
+{
+    RETURN_FALSE_IF_NOT_INIT();
+    Mutex::Autolock _l(mLock);
+
+    if (!mConnected || !display || mBlank)
+        return true;
+
     if (!mLayerList) {
         WTRACE("null HWC layer list");
         return true;
     }
 
+    HTRACE_SCOPE(DEVICE_PREPARE, mType, display->numHwLayers);
+
+    // planes are shared by all devices, allocate them in device order
+    mLayerList->allocateDeferredPlanes();
+
     // update list with new list
-    return mLayerList->update(display);
+    bool ret = mLayerList->update(display);
+
+    // plane contexts are final now, let commit reuse them
+    mHwc.getDisplayContext()->prepareContents(mType, display, mLayerList);
+    return ret;
 }
 
 
@@ -495,6 +517,11 @@ void PhysicalDevice::onVsync(int64_t timestamp)
     mHwc.vsync(mType, timestamp);
 }
 
+const VsyncRing* PhysicalDevice::getVsyncRing() const
+{
+    return mVsyncObserver ? &mVsyncObserver->getVsyncRing() : NULL;
+}
+
 void PhysicalDevice::dump(Dump& d)
 {
     Mutex::Autolock _l(mLock);
@@ -517,6 +544,10 @@ void PhysicalDevice::dump(Dump& d)
                      config->getDpiY());
         }
     }
+    // dump vsync pacing
+    if (mVsyncObserver)
+        mVsyncObserver->getVsyncRing().dump(d);
+
     // dump layer list
     if (mLayerList)
         mLayerList->dump(d);
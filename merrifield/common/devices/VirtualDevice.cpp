@@ -17,6 +17,7 @@
 #include <Hwcomposer.h>
 #include <DisplayPlaneManager.h>
 #include <DisplayQuery.h>
+#include <MemoryAccounting.h>
 #include <VirtualDevice.h>
 #include <SoftVsyncObserver.h>
 
@@ -43,6 +44,15 @@
 #define QCIF_WIDTH 176
 #define QCIF_HEIGHT 144
 
+// sample every Nth pixel of every Nth row for the frame checksum
+#define CHECKSUM_SAMPLE_STEP 8
+// force a real frame after this many suppressed duplicates, as the
+// sampled checksum can miss small updates
+#define MAX_REPEATED_FRAMES 30
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
 namespace android {
 namespace intel {
 
@@ -95,6 +105,42 @@ static void my_timeline_inc(const char* func, const char* timelineName, int& syn
 #define SYNC_WAIT_AND_CLOSE(fenceName)  my_sync_wait_and_close(__func__, #fenceName, fenceName)
 #define TIMELINE_INC(timelineName)      my_timeline_inc(__func__, #timelineName, timelineName)
 
+static inline uint32_t hashBytes(uint32_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    return hash;
+}
+
+static inline uint32_t hashLayer(uint32_t hash, const hwc_layer_1_t& layer)
+{
+    hash = hashBytes(hash, &layer.handle, sizeof(layer.handle));
+    hash = hashBytes(hash, &layer.sourceCropf, sizeof(layer.sourceCropf));
+    return hashBytes(hash, &layer.displayFrame, sizeof(layer.displayFrame));
+}
+
+// Sampled content signature of an RGB buffer. Each sampled row starts at
+// a different column so that consecutive rows cover different pixels.
+static bool sampleChecksum(BufferMapper *mapper, uint32_t *checksum)
+{
+    const uint8_t* base = static_cast<const uint8_t*>(mapper->getCpuAddress(0));
+    uint32_t stride = mapper->getStride().rgb.stride;
+    uint32_t width = mapper->getWidth();
+    uint32_t height = mapper->getHeight();
+    if (base == NULL || stride < width * 4)
+        return false;
+
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (uint32_t y = 0; y < height; y += CHECKSUM_SAMPLE_STEP) {
+        const uint32_t* row = reinterpret_cast<const uint32_t*>(base + y * stride);
+        for (uint32_t x = (y / CHECKSUM_SAMPLE_STEP) % CHECKSUM_SAMPLE_STEP; x < width; x += CHECKSUM_SAMPLE_STEP)
+            hash = (hash ^ row[x]) * FNV_PRIME;
+    }
+    *checksum = hash;
+    return true;
+}
+
 class MappedSurface {
 public:
     MappedSurface(VADisplay dpy, VASurfaceID surf)
@@ -138,6 +184,7 @@ class VirtualDevice::VAMappedHandle {
 public:
     VAMappedHandle(VADisplay dpy, buffer_handle_t handle, uint32_t stride, uint32_t height, unsigned int pixel_format)
         : va_dpy(dpy),
+          size(0),
           surface(0)
     {
         VTRACE("Map gralloc %p size=%ux%u", handle, stride, height);
@@ -204,10 +251,15 @@ public:
         if (va_status != VA_STATUS_SUCCESS) {
             ETRACE("vaCreateSurfaces returns %08x, surface = %x", va_status, surface);
             surface = 0;
+            return;
         }
+        size = buf.data_size;
+        MemoryAccounting::add(MemoryAccounting::MEM_VA_SURFACE,
+                              IDisplayDevice::DEVICE_VIRTUAL, size);
     }
     VAMappedHandle(VADisplay dpy, buffer_handle_t khandle, uint32_t stride, uint32_t height, bool tiled)
         : va_dpy(dpy),
+          size(0),
           surface(0)
     {
         int format;
@@ -241,7 +293,11 @@ public:
         if (va_status != VA_STATUS_SUCCESS) {
             ETRACE("vaCreateSurfacesWithAttribute returns %08x", va_status);
             surface = 0;
+            return;
         }
+        size = attribTpi.size;
+        MemoryAccounting::add(MemoryAccounting::MEM_VA_SURFACE,
+                              IDisplayDevice::DEVICE_VIRTUAL, size);
     }
     ~VAMappedHandle()
     {
@@ -250,9 +306,13 @@ public:
         VAStatus va_status;
         va_status = vaDestroySurfaces(va_dpy, &surface, 1);
         if (va_status != VA_STATUS_SUCCESS) ETRACE("vaDestroySurfaces returns %08x", va_status);
+        MemoryAccounting::remove(MemoryAccounting::MEM_VA_SURFACE,
+                                 IDisplayDevice::DEVICE_VIRTUAL, size);
     }
 private:
     VADisplay va_dpy;
+    // bytes of the mapped buffer reported to MemoryAccounting
+    uint32_t size;
 public:
     VASurfaceID surface;
 };
@@ -308,9 +368,35 @@ struct VirtualDevice::Task : public RefBase {
 };
 
 struct VirtualDevice::RenderTask : public VirtualDevice::Task {
-    RenderTask() : successful(false) { }
+    RenderTask()
+        : successful(false),
+          skipIfRepeated(false),
+          repeated(false),
+          frameKey(0),
+          checksum(0) { }
     virtual void run(VirtualDevice& vd) = 0;
+    // Must be called once the RGB input's acquire fence has signaled.
+    // Returns true if this frame matches the last one sent to the frame
+    // listener, in which case rendering can be skipped.
+    bool checkRepeated(VirtualDevice& vd) {
+        if (!skipIfRepeated)
+            return false;
+        if (checksumBuffer != NULL &&
+            (checksumBuffer->mapper == NULL ||
+             !sampleChecksum(checksumBuffer->mapper, &checksum))) {
+            skipIfRepeated = false;
+            return false;
+        }
+        checksumBuffer = NULL;
+        repeated = vd.isRepeatedFrame(frameKey, checksum);
+        return repeated;
+    }
     bool successful;
+    bool skipIfRepeated;
+    bool repeated;
+    uint32_t frameKey;
+    uint32_t checksum;
+    sp<CachedBuffer> checksumBuffer;
 };
 
 struct VirtualDevice::ComposeTask : public VirtualDevice::RenderTask {
@@ -343,6 +429,14 @@ struct VirtualDevice::ComposeTask : public VirtualDevice::RenderTask {
         }
 
         SYNC_WAIT_AND_CLOSE(yuvAcquireFenceFd);
+        SYNC_WAIT_AND_CLOSE(rgbAcquireFenceFd);
+
+        if (checkRepeated(vd)) {
+            VTRACE("Frame unchanged, skipping composition");
+            TIMELINE_INC(syncTimelineFd);
+            successful = true;
+            return;
+        }
 
         VASurfaceID videoInSurface;
         if (videoKhandle == 0) {
@@ -361,7 +455,6 @@ struct VirtualDevice::ComposeTask : public VirtualDevice::RenderTask {
             ETRACE("Couldn't map video");
             return;
         }
-        SYNC_WAIT_AND_CLOSE(rgbAcquireFenceFd);
         SYNC_WAIT_AND_CLOSE(outbufAcquireFenceFd);
 
         VAMappedHandle mappedVideoOut(vd.va_dpy, outputHandle, align_width(outWidth), align_height(outHeight), (unsigned int)VA_FOURCC_NV12);
@@ -461,6 +554,12 @@ struct VirtualDevice::BlitTask : public VirtualDevice::RenderTask {
 
     virtual void run(VirtualDevice& vd) {
         SYNC_WAIT_AND_CLOSE(srcAcquireFenceFd);
+        if (checkRepeated(vd)) {
+            VTRACE("Frame unchanged, skipping blit");
+            TIMELINE_INC(syncTimelineFd);
+            successful = true;
+            return;
+        }
         SYNC_WAIT_AND_CLOSE(destAcquireFenceFd);
         BufferManager* mgr = vd.mHwc.getBufferManager();
         if (!(mgr->blit(srcHandle, destHandle, destRect, false, false))) {
@@ -515,6 +614,22 @@ struct VirtualDevice::OnFrameReadyTask : public VirtualDevice::Task {
         if (renderTask != NULL && !renderTask->successful)
             return;
 
+        if (renderTask != NULL && renderTask->repeated) {
+            // Nothing was rendered, announce the last frame again instead.
+            // If the listener still holds that buffer it has the frame already.
+            Mutex::Autolock _l(vd.mHeldBuffersLock);
+            if (vd.mLastFrameHandle == NULL || vd.mHeldBuffers.indexOfKey(vd.mLastFrameHandle) >= 0)
+                return;
+            handle = vd.mLastFrameHandle;
+            heldBuffer = vd.mLastFrameHeldBuffer;
+        } else if (renderTask != NULL && renderTask->skipIfRepeated) {
+            vd.mLastFrameKey = renderTask->frameKey;
+            vd.mLastFrameChecksum = renderTask->checksum;
+            vd.mLastFrameHandle = handle;
+            vd.mLastFrameHeldBuffer = heldBuffer;
+            vd.mRepeatedFrames = 0;
+        }
+
         {
             Mutex::Autolock _l(vd.mHeldBuffersLock);
             //Add the heldbuffer to the vector before calling onFrameReady, so that the buffer will be removed
@@ -545,6 +660,14 @@ struct VirtualDevice::OnFrameReadyTask : public VirtualDevice::Task {
     int64_t mediaTimestamp;
 };
 
+struct VirtualDevice::ResetLastFrameTask : public VirtualDevice::Task {
+    virtual void run(VirtualDevice& vd) {
+        vd.mLastFrameHandle = NULL;
+        vd.mLastFrameHeldBuffer = NULL;
+        vd.mRepeatedFrames = 0;
+    }
+};
+
 struct VirtualDevice::BufferList::HeldBuffer : public RefBase {
     HeldBuffer(BufferList& list, buffer_handle_t handle, uint32_t w, uint32_t h)
         : mList(list),
@@ -559,8 +682,7 @@ struct VirtualDevice::BufferList::HeldBuffer : public RefBase {
             mList.mAvailableBuffers.push_back(mHandle);
         } else {
             VTRACE("Deleting %s buffer %p (%ux%u)", mList.mName, mHandle, mWidth, mHeight);
-            BufferManager* mgr = mList.mVd.mHwc.getBufferManager();
-            mgr->freeGrallocBuffer((mHandle));
+            mList.freeBuffer(mHandle, mWidth, mHeight);
             if (mList.mBuffersToCreate < mList.mLimit)
                 mList.mBuffersToCreate++;
         }
@@ -573,18 +695,35 @@ struct VirtualDevice::BufferList::HeldBuffer : public RefBase {
 };
 
 VirtualDevice::BufferList::BufferList(VirtualDevice& vd, const char* name,
-                                      uint32_t limit, uint32_t format, uint32_t usage)
+                                      uint32_t limit, uint32_t format, uint32_t usage,
+                                      int memCategory)
     : mVd(vd),
       mName(name),
       mLimit(limit),
       mFormat(format),
       mUsage(usage),
+      mMemCategory(memCategory),
       mBuffersToCreate(0),
       mWidth(0),
       mHeight(0)
 {
 }
 
+uint32_t VirtualDevice::BufferList::bufferSize(uint32_t width, uint32_t height) const
+{
+    if (mFormat == HAL_PIXEL_FORMAT_BGRA_8888)
+        return width * height * 4;
+    // NV12
+    return width * height * 3 / 2;
+}
+
+void VirtualDevice::BufferList::freeBuffer(buffer_handle_t handle, uint32_t width, uint32_t height)
+{
+    mVd.mHwc.getBufferManager()->freeGrallocBuffer(handle);
+    MemoryAccounting::remove(mMemCategory, IDisplayDevice::DEVICE_VIRTUAL,
+                             bufferSize(width, height));
+}
+
 buffer_handle_t VirtualDevice::BufferList::get(uint32_t width, uint32_t height, sp<RefBase>* heldBuffer)
 {
     width = align_width(width);
@@ -609,6 +748,8 @@ buffer_handle_t VirtualDevice::BufferList::get(uint32_t width, uint32_t height,
             ETRACE("failed to allocate %s buffer", mName);
             return NULL;
         }
+        MemoryAccounting::add(mMemCategory, IDisplayDevice::DEVICE_VIRTUAL,
+                              bufferSize(width, height));
         mBuffersToCreate--;
     }
     else {
@@ -627,7 +768,7 @@ void VirtualDevice::BufferList::clear()
         // iterate the list and call freeGraphicBuffer
         for (List<buffer_handle_t>::iterator i = mAvailableBuffers.begin(); i != mAvailableBuffers.end(); ++i) {
             VTRACE("Deleting the gralloc buffer associated with handle (%p)", (*i));
-            mVd.mHwc.getBufferManager()->freeGrallocBuffer((*i));
+            freeBuffer(*i, mWidth, mHeight);
         }
         mAvailableBuffers.clear();
     }
@@ -639,10 +780,12 @@ VirtualDevice::VirtualDevice(Hwcomposer& hwc)
     : mProtectedMode(false),
       mCscBuffers(*this, "CSC",
                   NUM_CSC_BUFFERS, DisplayQuery::queryNV12Format(),
-                  GRALLOC_USAGE_HW_VIDEO_ENCODER | GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_PRIVATE_1),
+                  GRALLOC_USAGE_HW_VIDEO_ENCODER | GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_PRIVATE_1,
+                  MemoryAccounting::MEM_WIDI_CSC_BUFFER),
       mRgbUpscaleBuffers(*this, "RGB upscale",
                          NUM_SCALING_BUFFERS, HAL_PIXEL_FORMAT_BGRA_8888,
-                         GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER),
+                         GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER,
+                         MemoryAccounting::MEM_WIDI_UPSCALE_BUFFER),
       mInitialized(false),
       mHwc(hwc),
       mPayloadManager(NULL),
@@ -684,6 +827,18 @@ sp<VirtualDevice::CachedBuffer> VirtualDevice::getMappedBuffer(buffer_handle_t h
     return cachedBuffer;
 }
 
+bool VirtualDevice::isRepeatedFrame(uint32_t frameKey, uint32_t checksum)
+{
+    if (mLastFrameHandle == NULL || frameKey != mLastFrameKey || checksum != mLastFrameChecksum)
+        return false;
+
+    if (++mRepeatedFrames >= MAX_REPEATED_FRAMES) {
+        VTRACE("%u repeated frames, forcing a refresh", mRepeatedFrames);
+        return false;
+    }
+    return true;
+}
+
 bool VirtualDevice::threadLoop()
 {
     sp<Task> task;
@@ -744,6 +899,9 @@ status_t VirtualDevice::stop(bool isConnected)
     {
         Mutex::Autolock _l(mTaskLock);
         mCscBuffers.clear();
+        // drop the buffer kept around for repeated frames
+        mTasks.push_back(new ResetLastFrameTask());
+        mRequestQueued.signal();
     }
     return NO_ERROR;
 }
@@ -806,6 +964,12 @@ bool VirtualDevice::prePrepare(hwc_display_contents_1_t *display)
     return true;
 }
 
+bool VirtualDevice::prepareLayers(hwc_display_contents_1_t *display)
+{
+    RETURN_FALSE_IF_NOT_INIT();
+    return true;
+}
+
 bool VirtualDevice::prepare(hwc_display_contents_1_t *display)
 {
     RETURN_FALSE_IF_NOT_INIT();
@@ -832,6 +996,8 @@ bool VirtualDevice::prepare(hwc_display_contents_1_t *display)
             mDebugVspClear = atoi(propertyVal);
         if (property_get("widi.compose.dump", propertyVal, NULL) > 0)
             mDebugVspDump = atoi(propertyVal);
+        if (property_get("widi.compose.skip_dup", propertyVal, NULL) > 0)
+            mSkipDuplicateFrames = atoi(propertyVal);
 
         Hwcomposer::getInstance().getMultiDisplayObserver()->notifyWidiConnectionStatus(shouldBeConnected);
         mLastConnectionStatus = shouldBeConnected;
@@ -1294,6 +1460,30 @@ bool VirtualDevice::queueCompose(hwc_display_contents_1_t *display)
     else
         composeTask->mappedRgbIn = NULL;
 
+#ifdef INTEL_WIDI
+    // Only frames that will be handed to the frame listener can be suppressed.
+    composeTask->skipIfRepeated = mSkipDuplicateFrames &&
+        mCurrentConfig.frameServerActive && mCurrentConfig.frameListener != NULL &&
+        mCurrentConfig.policy.scaledWidth != 0 && mCurrentConfig.policy.scaledHeight != 0;
+    if (composeTask->skipIfRepeated) {
+        uint32_t key = hashLayer(FNV_OFFSET_BASIS, yuvLayer);
+        key = hashBytes(key, &composeTask->videoKhandle, sizeof(composeTask->videoKhandle));
+        key = hashBytes(key, &videoMetadata.timestamp, sizeof(videoMetadata.timestamp));
+        key = hashBytes(key, &surface_region, sizeof(surface_region));
+        key = hashBytes(key, &output_region, sizeof(output_region));
+        key = hashBytes(key, &composeTask->outWidth, sizeof(composeTask->outWidth));
+        key = hashBytes(key, &composeTask->outHeight, sizeof(composeTask->outHeight));
+        if (mRgbLayer != -1) {
+            hwc_layer_1_t& rgbLayer = display->hwLayers[mRgbLayer];
+            key = hashLayer(key, rgbLayer);
+            composeTask->checksumBuffer = getMappedBuffer(rgbLayer.handle);
+            if (composeTask->checksumBuffer == NULL)
+                composeTask->skipIfRepeated = false;
+        }
+        composeTask->frameKey = key;
+    }
+#endif
+
     mTasks.push_back(composeTask);
     mRequestQueued.signal();
 #ifdef INTEL_WIDI
@@ -1323,15 +1513,15 @@ bool VirtualDevice::queueCompose(hwc_display_contents_1_t *display)
         FrameInfo outputFrameInfo = inputFrameInfo;
 
         BufferManager* mgr = mHwc.getBufferManager();
-        DataBuffer* dataBuf = mgr->lockDataBuffer(composeTask->outputHandle);
+        BufferInfo dataBuf;
+        mgr->getBufferInfo(composeTask->outputHandle, dataBuf);
         outputFrameInfo.contentWidth = composeTask->outWidth;
         outputFrameInfo.contentHeight = composeTask->outHeight;
-        outputFrameInfo.bufferWidth = dataBuf->getWidth();
-        outputFrameInfo.bufferHeight = dataBuf->getHeight();
-        outputFrameInfo.lumaUStride = dataBuf->getWidth();
-        outputFrameInfo.chromaUStride = dataBuf->getWidth();
-        outputFrameInfo.chromaVStride = dataBuf->getWidth();
-        mgr->unlockDataBuffer(dataBuf);
+        outputFrameInfo.bufferWidth = dataBuf.getWidth();
+        outputFrameInfo.bufferHeight = dataBuf.getHeight();
+        outputFrameInfo.lumaUStride = dataBuf.getWidth();
+        outputFrameInfo.chromaUStride = dataBuf.getWidth();
+        outputFrameInfo.chromaVStride = dataBuf.getWidth();
 
         queueFrameTypeInfo(inputFrameInfo);
         if (mCurrentConfig.policy.scaledWidth == 0 || mCurrentConfig.policy.scaledHeight == 0)
@@ -1447,6 +1637,19 @@ bool VirtualDevice::queueColorConvert(hwc_display_contents_1_t *display)
         return false;
     }
 
+#ifdef INTEL_WIDI
+    // Only frames that will be handed to the frame listener can be suppressed.
+    blitTask->skipIfRepeated = mSkipDuplicateFrames &&
+        mCurrentConfig.frameServerActive && mCurrentConfig.frameListener != NULL &&
+        mCurrentConfig.policy.scaledWidth != 0 && mCurrentConfig.policy.scaledHeight != 0;
+    if (blitTask->skipIfRepeated) {
+        blitTask->frameKey = hashLayer(FNV_OFFSET_BASIS, layer);
+        blitTask->checksumBuffer = getMappedBuffer(layer.handle);
+        if (blitTask->checksumBuffer == NULL)
+            blitTask->skipIfRepeated = false;
+    }
+#endif
+
     mTasks.push_back(blitTask);
     mRequestQueued.signal();
 #ifdef INTEL_WIDI
@@ -1464,13 +1667,13 @@ bool VirtualDevice::queueColorConvert(hwc_display_contents_1_t *display)
         outputFrameInfo = inputFrameInfo;
 
         BufferManager* mgr = mHwc.getBufferManager();
-        DataBuffer* dataBuf = mgr->lockDataBuffer(blitTask->destHandle);
-        outputFrameInfo.bufferWidth = dataBuf->getWidth();
-        outputFrameInfo.bufferHeight = dataBuf->getHeight();
-        outputFrameInfo.lumaUStride = dataBuf->getWidth();
-        outputFrameInfo.chromaUStride = dataBuf->getWidth();
-        outputFrameInfo.chromaVStride = dataBuf->getWidth();
-        mgr->unlockDataBuffer(dataBuf);
+        BufferInfo dataBuf;
+        mgr->getBufferInfo(blitTask->destHandle, dataBuf);
+        outputFrameInfo.bufferWidth = dataBuf.getWidth();
+        outputFrameInfo.bufferHeight = dataBuf.getHeight();
+        outputFrameInfo.lumaUStride = dataBuf.getWidth();
+        outputFrameInfo.chromaUStride = dataBuf.getWidth();
+        outputFrameInfo.chromaVStride = dataBuf.getWidth();
 
         if (!mIsForceCloneMode)
             queueFrameTypeInfo(inputFrameInfo);
@@ -1669,15 +1872,15 @@ bool VirtualDevice::handleExtendedMode(hwc_display_contents_1_t *display)
         composeTask->videoTiled = info.tiled;
 
         BufferManager* mgr = mHwc.getBufferManager();
-        DataBuffer* dataBuf = mgr->lockDataBuffer(composeTask->outputHandle);
+        BufferInfo dataBuf;
+        mgr->getBufferInfo(composeTask->outputHandle, dataBuf);
         outputFrameInfo.contentWidth = composeTask->outWidth;
         outputFrameInfo.contentHeight = composeTask->outHeight;
-        outputFrameInfo.bufferWidth = dataBuf->getWidth();
-        outputFrameInfo.bufferHeight = dataBuf->getHeight();
-        outputFrameInfo.lumaUStride = dataBuf->getWidth();
-        outputFrameInfo.chromaUStride = dataBuf->getWidth();
-        outputFrameInfo.chromaVStride = dataBuf->getWidth();
-        mgr->unlockDataBuffer(dataBuf);
+        outputFrameInfo.bufferWidth = dataBuf.getWidth();
+        outputFrameInfo.bufferHeight = dataBuf.getHeight();
+        outputFrameInfo.lumaUStride = dataBuf.getWidth();
+        outputFrameInfo.chromaUStride = dataBuf.getWidth();
+        outputFrameInfo.chromaVStride = dataBuf.getWidth();
 
         handle = composeTask->outputHandle;
         handleType = HWC_HANDLE_TYPE_GRALLOC;
@@ -2286,6 +2489,11 @@ bool VirtualDevice::initialize()
     va_context = 0;
     va_blank_yuv_in = 0;
     va_blank_rgb_in = 0;
+    mSkipDuplicateFrames = true;
+    mLastFrameKey = 0;
+    mLastFrameChecksum = 0;
+    mLastFrameHandle = NULL;
+    mRepeatedFrames = 0;
     mVspUpscale = false;
     mDebugVspClear = false;
     mDebugVspDump = false;
@@ -0,0 +1,356 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <HwcTrace.h>
+#include <EventLoop.h>
+
+namespace android {
+namespace intel {
+
+EventLoop::EventLoop()
+    : mEpollFd(-1),
+      mWakeFd(-1),
+      mLock(),
+      mDispatchCondition(),
+      mHandlers(),
+      mDispatchingFd(-1),
+      mThreadId(0),
+      mExitThread(false),
+      mWakeups(0),
+      mInitialized(false)
+{
+}
+
+EventLoop::~EventLoop()
+{
+    WARN_IF_NOT_DEINIT();
+}
+
+bool EventLoop::initialize(const char *name)
+{
+    if (mInitialized) {
+        WTRACE("object has been initialized");
+        return true;
+    }
+
+    mEpollFd = epoll_create(MAX_EVENTS);
+    if (mEpollFd < 0) {
+        DEINIT_AND_RETURN_FALSE("failed to create epoll fd, error = %d", errno);
+    }
+
+    mWakeFd = eventfd(0, EFD_NONBLOCK);
+    if (mWakeFd < 0) {
+        DEINIT_AND_RETURN_FALSE("failed to create event fd, error = %d", errno);
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = mWakeFd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event) < 0) {
+        DEINIT_AND_RETURN_FALSE("failed to add event fd, error = %d", errno);
+    }
+
+    mExitThread = false;
+    mThread = new EventLoopThread(this);
+    if (!mThread.get()) {
+        DEINIT_AND_RETURN_FALSE("failed to create event loop thread");
+    }
+    mThread->run(name, PRIORITY_URGENT_DISPLAY);
+
+    mInitialized = true;
+    return true;
+}
+
+void EventLoop::deinitialize()
+{
+    if (mHandlers.size()) {
+        WTRACE("%d handlers are still registered", (int)mHandlers.size());
+    }
+
+    if (mThread.get()) {
+        mExitThread = true;
+        uint64_t value = 1;
+        if (write(mWakeFd, &value, sizeof(value)) != sizeof(value)) {
+            WTRACE("failed to wake up event loop, error = %d", errno);
+        }
+        mThread->requestExitAndWait();
+        mThread = NULL;
+    }
+
+    if (mWakeFd >= 0) {
+        close(mWakeFd);
+        mWakeFd = -1;
+    }
+
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
+
+    mHandlers.clear();
+    mInitialized = false;
+}
+
+bool EventLoop::addFd(int fd, EventHandlerFunc func, void *data, const char *name)
+{
+    if (fd < 0 || !func) {
+        ETRACE("invalid fd %d or handler", fd);
+        return false;
+    }
+
+    Mutex::Autolock _l(mLock);
+
+    if (mHandlers.indexOfKey(fd) >= 0) {
+        ETRACE("handler for fd %d exists", fd);
+        return false;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ETRACE("failed to add fd %d, error = %d", fd, errno);
+        return false;
+    }
+
+    EventHandler handler;
+    handler.func = func;
+    handler.data = data;
+    handler.name = String8(name ? name : "");
+    handler.count = 0;
+    mHandlers.add(fd, handler);
+    return true;
+}
+
+void EventLoop::removeFd(int fd)
+{
+    Mutex::Autolock _l(mLock);
+
+    ssize_t index = mHandlers.indexOfKey(fd);
+    if (index < 0) {
+        return;
+    }
+
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+        WTRACE("failed to remove fd %d, error = %d", fd, errno);
+    }
+    mHandlers.removeItemsAt(index);
+
+    // a handler may remove itself or others from the loop thread
+    if (isLoopThread()) {
+        return;
+    }
+
+    while (mDispatchingFd == fd) {
+        mDispatchCondition.wait(mLock);
+    }
+}
+
+bool EventLoop::isLoopThread() const
+{
+    return mThreadId == gettid();
+}
+
+bool EventLoop::dispatch(int fd)
+{
+    EventHandlerFunc func;
+    void *data;
+
+    {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mHandlers.indexOfKey(fd);
+        if (index < 0) {
+            // removed after epoll_wait returned
+            return false;
+        }
+        EventHandler& handler = mHandlers.editValueAt(index);
+        handler.count++;
+        func = handler.func;
+        data = handler.data;
+        mDispatchingFd = fd;
+    }
+
+    func(fd, data);
+
+    {
+        Mutex::Autolock _l(mLock);
+        mDispatchingFd = -1;
+        mDispatchCondition.broadcast();
+    }
+    return true;
+}
+
+bool EventLoop::threadLoop()
+{
+    if (!mThreadId) {
+        mThreadId = gettid();
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(mEpollFd, events, MAX_EVENTS, -1);
+    if (count < 0) {
+        if (errno != EINTR) {
+            ETRACE("epoll_wait failed, error = %d", errno);
+            return false;
+        }
+        return true;
+    }
+
+    mWakeups++;
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        if (fd == mWakeFd) {
+            uint64_t value;
+            read(mWakeFd, &value, sizeof(value));
+            if (mExitThread) {
+                ITRACE("exiting event loop");
+                return false;
+            }
+            continue;
+        }
+        dispatch(fd);
+    }
+    return true;
+}
+
+void EventLoop::dump(Dump& d)
+{
+    Mutex::Autolock _l(mLock);
+
+    d.append("Event loop: %u wakeups\n", mWakeups);
+    d.append("  FD | EVENTS   | HANDLER\n");
+    d.append("-----+----------+------------------------\n");
+    for (size_t i = 0; i < mHandlers.size(); i++) {
+        const EventHandler& handler = mHandlers.valueAt(i);
+        d.append("%4d | %8u | %s\n",
+                 mHandlers.keyAt(i), handler.count, handler.name.string());
+    }
+}
+
+EventTimer::EventTimer()
+    : mLoop(NULL),
+      mTimerFd(-1),
+      mFunc(NULL),
+      mData(NULL)
+{
+}
+
+EventTimer::~EventTimer()
+{
+    deinitialize();
+}
+
+bool EventTimer::initialize(EventLoop *loop, EventTimerFunc func, void *data,
+                            const char *name)
+{
+    if (mTimerFd >= 0) {
+        WTRACE("timer has been initialized");
+        return true;
+    }
+
+    if (!loop || !func) {
+        ETRACE("invalid event loop or callback");
+        return false;
+    }
+
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (mTimerFd < 0) {
+        ETRACE("failed to create timer fd, error = %d", errno);
+        return false;
+    }
+
+    mLoop = loop;
+    mFunc = func;
+    mData = data;
+    if (!mLoop->addFd(mTimerFd, onEvent, this, name)) {
+        deinitialize();
+        return false;
+    }
+    return true;
+}
+
+void EventTimer::deinitialize()
+{
+    if (mTimerFd < 0) {
+        return;
+    }
+
+    if (mLoop) {
+        mLoop->removeFd(mTimerFd);
+    }
+    close(mTimerFd);
+    mTimerFd = -1;
+    mLoop = NULL;
+}
+
+bool EventTimer::setAbsolute(nsecs_t when)
+{
+    if (mTimerFd < 0) {
+        return false;
+    }
+
+    // a zero expiration would disarm the timer
+    if (when <= 0) {
+        when = 1;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = when / 1000000000;
+    spec.it_value.tv_nsec = when % 1000000000;
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        ETRACE("failed to set timer, error = %d", errno);
+        return false;
+    }
+    return true;
+}
+
+bool EventTimer::setRelative(nsecs_t delay)
+{
+    return setAbsolute(systemTime(CLOCK_MONOTONIC) + delay);
+}
+
+void EventTimer::cancel()
+{
+    if (mTimerFd < 0) {
+        return;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    timerfd_settime(mTimerFd, 0, &spec, NULL);
+}
+
+void EventTimer::onEvent(int fd, void *data)
+{
+    EventTimer *timer = (EventTimer*)data;
+
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        // disarmed or re-armed after it expired
+        return;
+    }
+    timer->mFunc(timer->mData);
+}
+
+} // namespace intel
+} // namespace android
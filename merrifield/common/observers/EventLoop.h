@@ -0,0 +1,110 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <SimpleThread.h>
+#include <Dump.h>
+
+namespace android {
+namespace intel {
+
+typedef void (*EventHandlerFunc)(int fd, void *data);
+typedef void (*EventTimerFunc)(void *data);
+
+// A single thread waiting on all registered descriptors with epoll and
+// calling their handlers as they become readable. Handlers run on the
+// loop thread and delay each other, a handler which may block belongs
+// on Hwcomposer's worker loop rather than on its event loop.
+class EventLoop {
+public:
+    EventLoop();
+    virtual ~EventLoop();
+
+public:
+    bool initialize(const char *name);
+    void deinitialize();
+    // the descriptor must be non-blocking and stays owned by the caller
+    bool addFd(int fd, EventHandlerFunc func, void *data, const char *name);
+    // the handler is not running and will not be called once this returns
+    void removeFd(int fd);
+    bool isLoopThread() const;
+    void dump(Dump& d);
+
+private:
+    inline bool dispatch(int fd);
+
+private:
+    enum {
+        MAX_EVENTS = 8,
+    };
+
+    struct EventHandler {
+        EventHandlerFunc func;
+        void *data;
+        String8 name;
+        uint32_t count;
+    };
+
+    int mEpollFd;
+    // eventfd waking the loop up to exit
+    int mWakeFd;
+    mutable Mutex mLock;
+    Condition mDispatchCondition;
+    KeyedVector<int, EventHandler> mHandlers;
+    int mDispatchingFd;
+    volatile pid_t mThreadId;
+    bool mExitThread;
+    uint32_t mWakeups;
+    bool mInitialized;
+
+private:
+    DECLARE_THREAD(EventLoopThread, EventLoop);
+};
+
+// One-shot timer backed by a timerfd on an event loop, the callback runs
+// on the loop thread.
+class EventTimer {
+public:
+    EventTimer();
+    virtual ~EventTimer();
+
+public:
+    bool initialize(EventLoop *loop, EventTimerFunc func, void *data,
+                    const char *name);
+    // the callback is not running and will not be called once this returns
+    void deinitialize();
+    // absolute time in CLOCK_MONOTONIC
+    bool setAbsolute(nsecs_t when);
+    bool setRelative(nsecs_t delay);
+    void cancel();
+
+private:
+    static void onEvent(int fd, void *data);
+
+private:
+    EventLoop *mLoop;
+    int mTimerFd;
+    EventTimerFunc mFunc;
+    void *mData;
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* EVENT_LOOP_H */
@@ -93,8 +93,8 @@ MultiDisplayObserver::MultiDisplayObserver()
       mMDSDecoderConfig(NULL),
       mMDSCallback(NULL),
       mLock(),
-      mCondition(),
-      mThreadLoopCount(0),
+      mTimer(),
+      mInitRetryCount(0),
       mDeviceConnected(false),
       mExternalHdmiTiming(false),
       mInitialized(false)
@@ -196,20 +196,14 @@ void MultiDisplayObserver::deinitMDSClient()
 
 bool MultiDisplayObserver::initMDSClientAsync()
 {
-    if (mThread.get()) {
-        WTRACE("working thread has been already created.");
-        return true;
-    }
-
-    mThread = new MDSClientInitThread(this);
-    if (mThread.get() == NULL) {
-        ETRACE("failed to create MDS client init thread");
+    // connecting to the service blocks on binder
+    EventLoop *loop = Hwcomposer::getInstance().getWorkerLoop();
+    if (!mTimer.initialize(loop, onInitTimer, this, "mds client init")) {
+        ETRACE("failed to create MDS client init timer");
         return false;
     }
-    mThreadLoopCount = 0;
-    // TODO: check return value
-    mThread->run("MDSClientInitThread", PRIORITY_URGENT_DISPLAY);
-    return true;
+    mInitRetryCount = 0;
+    return mTimer.setRelative(0);
 }
 
 bool MultiDisplayObserver::initialize()
@@ -224,13 +218,13 @@ bool MultiDisplayObserver::initialize()
 
     // initialize MDS client once. This should succeed if MDS service starts
     // before surfaceflinger service is started.
-    // if surface flinger runs first, MDS client will be initialized asynchronously in
-    // a working thread
+    // if surface flinger runs first, MDS client will be initialized asynchronously
+    // from a timer on the event loop
     if (isMDSRunning()) {
         if (!initMDSClient()) {
             ETRACE("failed to initialize MDS client");
             // FIXME: NOT a common case for system server crash.
-            // Start a working thread to initialize MDS client if exception happens
+            // Retry from a timer to initialize MDS client if exception happens
             ret = initMDSClientAsync();
         }
     } else {
@@ -243,54 +237,50 @@ bool MultiDisplayObserver::initialize()
 
 void MultiDisplayObserver::deinitialize()
 {
-    sp<MDSClientInitThread> detachedThread;
     do {
         Mutex::Autolock _l(mLock);
 
-        if (mThread.get()) {
-            mCondition.signal();
-            detachedThread = mThread;
-            mThread = NULL;
-        }
-        mThreadLoopCount = 0;
+        mTimer.cancel();
+        mInitRetryCount = 0;
         deinitMDSClient();
         mInitialized = false;
     } while (0);
 
-    if (detachedThread.get()) {
-        detachedThread->requestExitAndWait();
-        detachedThread = NULL;
-    }
+    // waits for a running retry, so not under the lock
+    mTimer.deinitialize();
+}
+
+void MultiDisplayObserver::onInitTimer(void *data)
+{
+    MultiDisplayObserver *pThis = (MultiDisplayObserver*)data;
+    pThis->onInitTimer();
 }
 
-bool MultiDisplayObserver::threadLoop()
+void MultiDisplayObserver::onInitTimer()
 {
     Mutex::Autolock _l(mLock);
 
-    // try to create MDS client in the working thread
+    if (!mInitialized) {
+        return;
+    }
+
+    // try to create MDS client from the timer
     // multiple delayed attempts are made until MDS service starts.
 
-    // Return false if MDS service is running or loop limit is reached
-    // such that thread becomes inactive.
+    // Stop retrying if MDS service is running or retry limit is reached
     if (isMDSRunning()) {
         if (!initMDSClient()) {
             ETRACE("failed to initialize MDS client");
         }
-        return false;
+        return;
     }
 
-    if (mThreadLoopCount++ > THREAD_LOOP_BOUND) {
-        ETRACE("failed to initialize MDS client, loop limit reached");
-        return false;
-    }
-
-    status_t err = mCondition.waitRelative(mLock, milliseconds(THREAD_LOOP_DELAY));
-    if (err != -ETIMEDOUT) {
-        ITRACE("thread is interrupted");
-        return false;
+    if (mInitRetryCount++ > INIT_RETRY_BOUND) {
+        ETRACE("failed to initialize MDS client, retry limit reached");
+        return;
     }
 
-    return true; // keep trying
+    mTimer.setRelative(milliseconds(INIT_RETRY_DELAY)); // keep trying
 }
 
 
@@ -18,7 +18,7 @@
 
 #ifdef TARGET_HAS_MULTIPLE_DISPLAY
 #include <display/MultiDisplayService.h>
-#include <SimpleThread.h>
+#include <EventLoop.h>
 #else
 #include <utils/Errors.h>
 #endif
@@ -82,6 +82,8 @@ private:
     bool initMDSClient();
     bool initMDSClientAsync();
     void deinitMDSClient();
+    static void onInitTimer(void *data);
+    void onInitTimer();
     status_t blankSecondaryDisplay(bool blank);
     status_t updateVideoState(int sessionId, MDS_VIDEO_STATE state);
     status_t setHdmiTiming(const MDSHdmiTiming& timing);
@@ -90,8 +92,8 @@ private:
 
 private:
     enum {
-        THREAD_LOOP_DELAY = 10, // 10 ms
-        THREAD_LOOP_BOUND = 2000, // 20s
+        INIT_RETRY_DELAY = 10, // 10 ms
+        INIT_RETRY_BOUND = 2000, // 20s
     };
 
 private:
@@ -101,15 +103,12 @@ private:
     sp<IMultiDisplayDecoderConfig> mMDSDecoderConfig;
     sp<MultiDisplayCallback> mMDSCallback;
     mutable Mutex mLock;
-    Condition mCondition;
-    int mThreadLoopCount;
+    EventTimer mTimer;
+    int mInitRetryCount;
     bool mDeviceConnected;
     // indicate external devices's timing is set
     bool mExternalHdmiTiming;
     bool mInitialized;
-
-private:
-    DECLARE_THREAD(MDSClientInitThread, MultiDisplayObserver);
 };
 
 #else
@@ -16,11 +16,8 @@
 #include <HwcTrace.h>
 #include <SoftVsyncObserver.h>
 #include <IDisplayDevice.h>
-
-extern "C" int clock_nanosleep(clockid_t clock_id, int flags,
-                           const struct timespec *request,
-                           struct timespec *remain);
-
+#include <VsyncModel.h>
+#include <Hwcomposer.h>
 
 namespace android {
 namespace intel {
@@ -32,9 +29,10 @@ SoftVsyncObserver::SoftVsyncObserver(IDisplayDevice& disp)
       mRefreshRate(60), // default 60 frames per second
       mRefreshPeriod(0),
       mLock(),
-      mCondition(),
       mNextFakeVSync(0),
-      mExitThread(false),
+      mVsyncModel(NULL),
+      mLastFakeVSync(0),
+      mTimer(),
       mInitialized(false)
 {
 }
@@ -51,15 +49,13 @@ bool SoftVsyncObserver::initialize()
         return true;
     }
 
-    mExitThread = false;
     mEnabled = false;
     mRefreshRate = 60/mDisplayDevice.getFpsDivider();
     mDevice = mDisplayDevice.getType();
-    mThread = new VsyncEventPollThread(this);
-    if (!mThread.get()) {
-        DEINIT_AND_RETURN_FALSE("failed to create vsync event poll thread.");
+    EventLoop *loop = Hwcomposer::getInstance().getEventLoop();
+    if (!mTimer.initialize(loop, onTimer, this, "soft vsync")) {
+        DEINIT_AND_RETURN_FALSE("failed to create soft vsync timer");
     }
-    mThread->run("SoftVsyncObserver", PRIORITY_URGENT_DISPLAY);
     mInitialized = true;
     return true;
 }
@@ -71,13 +67,7 @@ void SoftVsyncObserver::deinitialize()
         control(false);
     }
 
-    mExitThread = true;
-    mCondition.signal();
-
-    if (mThread.get()) {
-        mThread->requestExitAndWait();
-        mThread = NULL;
-    }
+    mTimer.deinitialize();
     mInitialized = false;
 }
 
@@ -92,64 +82,86 @@ void SoftVsyncObserver::setRefreshRate(int rate)
     }
 }
 
+void SoftVsyncObserver::setVsyncModel(VsyncModel *model)
+{
+    Mutex::Autolock _l(mLock);
+    mVsyncModel = model;
+}
+
 bool SoftVsyncObserver::control(bool enabled)
 {
+    Mutex::Autolock _l(mLock);
+
     if (enabled == mEnabled) {
         WTRACE("vsync state %d is not changed", enabled);
         return true;
     }
 
+    mEnabled = enabled;
     if (enabled) {
         mRefreshPeriod = nsecs_t(1e9 / mRefreshRate);
         mNextFakeVSync = systemTime(CLOCK_MONOTONIC) + mRefreshPeriod;
+        scheduleLocked();
+    } else {
+        mTimer.cancel();
     }
-    mEnabled = enabled;
-    mCondition.signal();
     return true;
 }
 
-bool SoftVsyncObserver::threadLoop()
+void SoftVsyncObserver::scheduleLocked()
 {
-    { // scope for lock
-        Mutex::Autolock _l(mLock);
-        while (!mEnabled) {
-            mCondition.wait(mLock);
-            if (mExitThread) {
-                ITRACE("exiting thread loop");
-                return false;
-            }
+    const nsecs_t period = mRefreshPeriod * mDisplayDevice.getFpsDivider();
+    const nsecs_t now = systemTime(CLOCK_MONOTONIC);
+    nsecs_t next_vsync = 0;
+
+    if (mVsyncModel) {
+        // stay in phase with the hardware vsync, the half period margin
+        // keeps the same vsync from being reported twice
+        nsecs_t after = now;
+        nsecs_t margin = mVsyncModel->getPeriod() / 2;
+        if (after < mLastFakeVSync + margin) {
+            after = mLastFakeVSync + margin;
         }
+        next_vsync = mVsyncModel->getNextVsync(after);
     }
 
-
-    const nsecs_t period = mRefreshPeriod * mDisplayDevice.getFpsDivider();
-    const nsecs_t now = systemTime(CLOCK_MONOTONIC);
-    nsecs_t next_vsync = mNextFakeVSync;
-    nsecs_t sleep = next_vsync - now;
-    if (sleep < 0) {
-        // we missed, find where the next vsync should be
-        sleep = (period - ((now - next_vsync) % period));
-        next_vsync = now + sleep;
+    if (!next_vsync) {
+        next_vsync = mNextFakeVSync;
+        nsecs_t sleep = next_vsync - now;
+        if (sleep < 0) {
+            // we missed, find where the next vsync should be
+            sleep = (period - ((now - next_vsync) % period));
+            next_vsync = now + sleep;
+        }
     }
     mNextFakeVSync = next_vsync + period;
+    mLastFakeVSync = next_vsync;
 
-    struct timespec spec;
-    spec.tv_sec  = next_vsync / 1000000000;
-    spec.tv_nsec = next_vsync % 1000000000;
+    mTimer.setAbsolute(next_vsync);
+}
 
-    int err;
-    do {
-        err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL);
-    } while (err < 0 && errno == EINTR);
+void SoftVsyncObserver::onTimer(void *data)
+{
+    SoftVsyncObserver *pThis = (SoftVsyncObserver*)data;
+    pThis->onTimer();
+}
 
+void SoftVsyncObserver::onTimer()
+{
+    nsecs_t timestamp;
 
-    if (err == 0) {
-        mDisplayDevice.onVsync(next_vsync);
+    {
+        Mutex::Autolock _l(mLock);
+        // vsync may have been disabled or re-enabled since the timer fired
+        timestamp = mLastFakeVSync;
+        if (!mEnabled || systemTime(CLOCK_MONOTONIC) < timestamp) {
+            return;
+        }
+        scheduleLocked();
     }
 
-    return true;
+    mDisplayDevice.onVsync(timestamp);
 }
 
 } // namespace intel
 } // namesapce android
-
@@ -16,12 +16,14 @@
 #ifndef SOFT_VSYNC_OBSERVER_H
 #define SOFT_VSYNC_OBSERVER_H
 
-#include <SimpleThread.h>
+#include <utils/threads.h>
+#include <EventLoop.h>
 
 namespace android {
 namespace intel {
 
 class IDisplayDevice;
+class VsyncModel;
 
 class SoftVsyncObserver {
 public:
@@ -33,6 +35,14 @@ public:
     virtual void deinitialize();
     virtual void setRefreshRate(int rate);
     virtual bool control(bool enabled);
+    // follow the given model instead of the nominal refresh rate when
+    // it is locked
+    virtual void setVsyncModel(VsyncModel *model);
+
+private:
+    static void onTimer(void *data);
+    void onTimer();
+    void scheduleLocked();
 
 private:
     IDisplayDevice& mDisplayDevice;
@@ -41,13 +51,11 @@ private:
     int mRefreshRate;
     nsecs_t mRefreshPeriod;
     mutable Mutex mLock;
-    Condition mCondition;
     mutable nsecs_t mNextFakeVSync;
-    bool mExitThread;
+    VsyncModel *mVsyncModel;
+    nsecs_t mLastFakeVSync;
+    EventTimer mTimer;
     bool mInitialized;
-
-private:
-    DECLARE_THREAD(VsyncEventPollThread, SoftVsyncObserver);
 };
 
 } // namespace intel
@@ -13,25 +13,26 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 */
-#include <poll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/queue.h>
 #include <linux/netlink.h>
+#include <linux/filter.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <DrmConfig.h>
 #include <HwcTrace.h>
 #include <UeventObserver.h>
+#include <Hwcomposer.h>
 
 namespace android {
 namespace intel {
 
 UeventObserver::UeventObserver()
     : mUeventFd(-1),
-      mExitRDFd(-1),
-      mExitWDFd(-1),
-      mListeners()
+      mStarted(false),
+      mListeners(),
+      mTrie()
 {
 }
 
@@ -43,17 +44,19 @@ UeventObserver::~UeventObserver()
 bool UeventObserver::initialize()
 {
     mListeners.clear();
+    mTrie.clear();
+
+    TrieNode root;
+    root.c = 0;
+    root.child = -1;
+    root.sibling = -1;
+    root.listener = -1;
+    mTrie.add(root);
 
     if (mUeventFd != -1) {
         return true;
     }
 
-    mThread = new UeventObserverThread(this);
-    if (!mThread.get()) {
-        ETRACE("failed to create uevent observer thread");
-        return false;
-    }
-
     // init uevent socket
     struct sockaddr_nl addr;
     // set the socket receive buffer to 64K
@@ -63,7 +66,8 @@ bool UeventObserver::initialize()
     memset(&addr, 0, sizeof(addr));
     addr.nl_family = AF_NETLINK;
     addr.nl_pid =  pthread_self() | getpid();
-    addr.nl_groups = 0xffffffff;
+    // kernel uevents only
+    addr.nl_groups = 1;
 
     mUeventFd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
     if (mUeventFd < 0) {
@@ -75,6 +79,11 @@ bool UeventObserver::initialize()
         //return false;
     }
 
+    // messages are still checked against the envelope if this fails
+    if (!attachFilter()) {
+        WTRACE("failed to attach uevent socket filter");
+    }
+
     if (bind(mUeventFd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
         DEINIT_AND_RETURN_FALSE("failed to bind scoket");
         return false;
@@ -82,127 +91,186 @@ bool UeventObserver::initialize()
 
     memset(mUeventMessage, 0, UEVENT_MSG_LEN);
 
-    int exitFds[2];
-    if (pipe(exitFds) < 0) {
-        ETRACE("failed to make pipe");
-        deinitialize();
-        return false;
-    }
-    mExitRDFd = exitFds[0];
-    mExitWDFd = exitFds[1];
-
     return true;
 }
 
 void UeventObserver::deinitialize()
 {
+    if (mStarted) {
+        Hwcomposer::getInstance().getWorkerLoop()->removeFd(mUeventFd);
+        mStarted = false;
+    }
+
     if (mUeventFd != -1) {
-        if (mExitWDFd != -1) {
-            close(mExitWDFd);
-            mExitWDFd = -1;
-        }
         close(mUeventFd);
         mUeventFd = -1;
     }
 
-    if (mThread.get()) {
-        mThread->requestExitAndWait();
-        mThread = NULL;
+    mListeners.clear();
+    mTrie.clear();
+}
+
+void UeventObserver::start()
+{
+    if (mUeventFd == -1 || mStarted) {
+        return;
     }
 
-    while (!mListeners.isEmpty()) {
-        UeventListener *listener = mListeners.valueAt(0);
-        mListeners.removeItemsAt(0);
-        delete listener;
+    // hotplug listeners read the EDID, keep them off the event loop
+    EventLoop *loop = Hwcomposer::getInstance().getWorkerLoop();
+    mStarted = loop->addFd(mUeventFd, onUeventFd, this, "uevent");
+    if (!mStarted) {
+        ETRACE("failed to add uevent socket to event loop");
     }
 }
 
-void UeventObserver::start()
+static inline void setFilter(struct sock_filter *filter, uint16_t code,
+                             uint32_t k, uint8_t jt, uint8_t jf)
 {
-    if (mThread.get()) {
-        mThread->run("UeventObserver", PRIORITY_URGENT_DISPLAY);
-    }
+    filter->code = code;
+    filter->jt = jt;
+    filter->jf = jf;
+    filter->k = k;
 }
 
+bool UeventObserver::attachFilter()
+{
+    // accept only messages starting with the envelope of our DRM device,
+    // compared four bytes at a time. Everything else is dropped by the
+    // kernel before it is queued on the socket.
+    const char *envelope = DrmConfig::getUeventEnvelope();
+    int len = strlen(envelope);
+    if (len == 0 || len > MAX_FILTER_ENVELOPE) {
+        return false;
+    }
+
+    struct sock_filter code[MAX_FILTER_ENVELOPE * 2 + 2];
+    int words = len / 4;
+    int bytes = len % 4;
+    int count = (words + bytes) * 2;
+    int n = 0;
+
+    // on mismatch jump to the reject statement at the end
+    for (int i = 0; i < words; i++) {
+        const unsigned char *p = (const unsigned char *)envelope + i * 4;
+        uint32_t value = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        setFilter(&code[n], BPF_LD | BPF_W | BPF_ABS, i * 4, 0, 0);
+        n++;
+        setFilter(&code[n], BPF_JMP | BPF_JEQ | BPF_K, value, 0, count - n);
+        n++;
+    }
+
+    for (int i = words * 4; i < len; i++) {
+        setFilter(&code[n], BPF_LD | BPF_B | BPF_ABS, i, 0, 0);
+        n++;
+        setFilter(&code[n], BPF_JMP | BPF_JEQ | BPF_K,
+                  (unsigned char)envelope[i], 0, count - n);
+        n++;
+    }
+
+    // accept
+    setFilter(&code[n++], BPF_RET | BPF_K, 0xffffffff, 0, 0);
+    // reject
+    setFilter(&code[n++], BPF_RET | BPF_K, 0, 0, 0);
+
+    struct sock_fprog filter;
+    filter.len = n;
+    filter.filter = code;
+    if (setsockopt(mUeventFd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter))) {
+        return false;
+    }
+    return true;
+}
 
 void UeventObserver::registerListener(const char *event, UeventListenerFunc func, void *data)
 {
-    if (!event || !func) {
+    if (!event || !*event || !func) {
         ETRACE("invalid event string or listener to register");
         return;
     }
 
-    String8 key(event);
-    if (mListeners.indexOfKey(key) >= 0) {
-        ETRACE("listener for uevent %s exists", event);
+    if (mTrie.isEmpty()) {
+        ETRACE("uevent observer is not initialized");
         return;
     }
 
-    UeventListener *listener = new UeventListener;
-    if (!listener) {
-        ETRACE("failed to create Uevent Listener");
+    // walk down the trie, adding the missing nodes
+    int node = 0;
+    for (const char *c = event; *c; c++) {
+        int child = mTrie[node].child;
+        while (child >= 0 && mTrie[child].c != *c) {
+            child = mTrie[child].sibling;
+        }
+        if (child < 0) {
+            TrieNode entry;
+            entry.c = *c;
+            entry.child = -1;
+            entry.sibling = mTrie[node].child;
+            entry.listener = -1;
+            child = mTrie.add(entry);
+            mTrie.editItemAt(node).child = child;
+        }
+        node = child;
+    }
+
+    if (mTrie[node].listener >= 0) {
+        ETRACE("listener for uevent %s exists", event);
         return;
     }
-    listener->func = func;
-    listener->data = data;
 
-    mListeners.add(key, listener);
+    UeventListener listener;
+    listener.func = func;
+    listener.data = data;
+    mTrie.editItemAt(node).listener = mListeners.add(listener);
 }
 
-bool UeventObserver::threadLoop()
+int UeventObserver::findListener(const char *entry) const
 {
-    if (mUeventFd == -1) {
-        ETRACE("invalid uEvent file descriptor");
-        return false;
+    int node = 0;
+    for (const char *c = entry; *c; c++) {
+        int child = mTrie[node].child;
+        while (child >= 0 && mTrie[child].c != *c) {
+            child = mTrie[child].sibling;
+        }
+        if (child < 0) {
+            return -1;
+        }
+        node = child;
     }
+    return mTrie[node].listener;
+}
 
-    struct pollfd fds[2];
-    int nr;
-
-    fds[0].fd = mUeventFd;
-    fds[0].events = POLLIN;
-    fds[0].revents = 0;
-    fds[1].fd = mExitRDFd;
-    fds[1].events = POLLIN;
-    fds[1].revents = 0;
-    nr = poll(fds, 2, -1);
-
-    if (nr > 0 && fds[0].revents == POLLIN) {
-        int count = recv(mUeventFd, mUeventMessage, UEVENT_MSG_LEN - 2, 0);
-        if (count > 0) {
-            onUevent();
-        }
-    } else if (fds[1].revents) {
-        close(mExitRDFd);
-        mExitRDFd = -1;
-        ITRACE("exiting wait");
-        return false;
+void UeventObserver::onUeventFd(int fd, void *data)
+{
+    UeventObserver *pThis = (UeventObserver*)data;
+
+    // drain all queued messages in one wakeup
+    int count;
+    while ((count = recv(fd, pThis->mUeventMessage, UEVENT_MSG_LEN - 2, MSG_DONTWAIT)) > 0) {
+        pThis->mUeventMessage[count] = '\0';
+        pThis->mUeventMessage[count + 1] = '\0';
+        pThis->onUevent(count);
     }
-    // always looping
-    return true;
 }
 
-void UeventObserver::onUevent()
+void UeventObserver::onUevent(int length)
 {
-    char *msg = mUeventMessage;
+    // the message is a sequence of NUL terminated strings, the envelope
+    // followed by "key=value" entries, matched in place
+    const char *msg = mUeventMessage;
+    const char *end = mUeventMessage + length;
     const char *envelope = DrmConfig::getUeventEnvelope();
     if (strncmp(msg, envelope, strlen(envelope)) != 0)
         return;
 
     msg += strlen(msg) + 1;
 
-    UeventListener *listener;
-    String8 key;
-    while (*msg) {
-        key = String8(msg);
-        if (mListeners.indexOfKey(key) >= 0) {
+    while (msg < end && *msg) {
+        int index = findListener(msg);
+        if (index >= 0) {
             DTRACE("received Uevent: %s", msg);
-            listener = mListeners.valueFor(key);
-            if (listener) {
-                listener->func(listener->data);
-            } else {
-                ETRACE("no listener for uevent %s", msg);
-            }
+            const UeventListener& listener = mListeners[index];
+            listener.func(listener.data);
         }
         msg += strlen(msg) + 1;
     }
@@ -210,4 +278,3 @@ void UeventObserver::onUevent()
 
 } // namespace intel
 } // namespace android
-
@@ -16,6 +16,7 @@
 #include <HwcTrace.h>
 #include <VsyncEventObserver.h>
 #include <PhysicalDevice.h>
+#include <Hwcomposer.h>
 
 namespace android {
 namespace intel {
@@ -29,7 +30,8 @@ VsyncEventObserver::VsyncEventObserver(PhysicalDevice& disp)
       mEnabled(false),
       mExitThread(false),
       mInitialized(false),
-      mFpsCounter(0)
+      mFpsCounter(0),
+      mVsyncRing()
 {
     CTRACE();
 }
@@ -109,6 +111,9 @@ bool VsyncEventObserver::threadLoop()
     do {
         // scope for lock
         Mutex::Autolock _l(mLock);
+        if (!mEnabled) {
+            mVsyncRing.resume();
+        }
         while (!mEnabled) {
             mCondition.wait(mLock);
             if (mExitThread) {
@@ -123,9 +128,20 @@ bool VsyncEventObserver::threadLoop()
         bool ret = mVsyncControl->wait(mDevice, timestamp);
         if (ret == false) {
             WTRACE("failed to wait for vsync on display %d, vsync enabled %d", mDevice, mEnabled);
-            usleep(16000);
+            mVsyncRing.addWaitFailure();
+            // back off for one vsync period
+            nsecs_t period = mVsyncRing.getPeriod();
+            usleep(period ? period / 1000 : 16000);
+            mVsyncRing.resume();
             return true;
         }
+        mVsyncRing.add(timestamp, systemTime(CLOCK_MONOTONIC));
+
+        // every hardware vsync counts, including those divided away below
+        IDisplayContext *context = Hwcomposer::getInstance().getDisplayContext();
+        if (context) {
+            context->onVsync(mDevice, timestamp);
+        }
 
         // send vsync event notification every hwc.fps_divider
         if ((mFpsCounter++) % mDisplayDevice.getFpsDivider() == 0)
@@ -18,6 +18,7 @@
 
 #include <SimpleThread.h>
 #include <IVsyncControl.h>
+#include <VsyncRing.h>
 
 namespace android {
 namespace intel {
@@ -33,6 +34,7 @@ public:
     virtual bool initialize();
     virtual void deinitialize();
     bool control(bool enabled);
+    const VsyncRing& getVsyncRing() const { return mVsyncRing; }
 
 private:
     mutable Mutex mLock;
@@ -44,6 +46,7 @@ private:
     bool mExitThread;
     bool mInitialized;
     unsigned int mFpsCounter;
+    VsyncRing mVsyncRing;
 
 private:
     DECLARE_THREAD(VsyncEventPollThread, VsyncEventObserver);
@@ -0,0 +1,161 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <HwcTrace.h>
+#include <cutils/atomic.h>
+#include <VsyncRing.h>
+
+namespace android {
+namespace intel {
+
+VsyncRing::VsyncRing()
+    : mWriteCount(0),
+      mLastTimestamp(0),
+      mPeriod(0),
+      mMissed(0),
+      mLate(0),
+      mWaitFailures(0)
+{
+    memset(mTimestamps, 0, sizeof(mTimestamps));
+}
+
+VsyncRing::~VsyncRing()
+{
+}
+
+void VsyncRing::add(nsecs_t timestamp, nsecs_t received)
+{
+    nsecs_t period = nsecs_t(mPeriod);
+
+    if (mLastTimestamp) {
+        nsecs_t interval = timestamp - mLastTimestamp;
+        if (!period) {
+            period = interval;
+        } else if (interval > period * 3 / 2) {
+            // vsyncs which never made it to user space
+            mMissed += (interval + period / 2) / period - 1;
+        } else {
+            period += (interval - period) / 8;
+        }
+        mPeriod = int32_t(period);
+    }
+    mLastTimestamp = timestamp;
+
+    // delivered later than a quarter of a period
+    if (period && received - timestamp > period / 4) {
+        mLate++;
+    }
+
+    int32_t count = mWriteCount;
+    mTimestamps[count & (RING_SIZE - 1)] = timestamp;
+    android_atomic_release_store(count + 1, &mWriteCount);
+}
+
+void VsyncRing::addWaitFailure()
+{
+    mWaitFailures++;
+}
+
+void VsyncRing::resume()
+{
+    mLastTimestamp = 0;
+}
+
+int VsyncRing::getTimestamps(nsecs_t *timestamps, int count) const
+{
+    int32_t end = android_atomic_acquire_load(&mWriteCount);
+    int32_t start = end - count;
+    if (start < end - RING_SIZE)
+        start = end - RING_SIZE;
+    if (start < 0)
+        start = 0;
+
+    for (int32_t i = start; i < end; i++) {
+        timestamps[i - start] = mTimestamps[i & (RING_SIZE - 1)];
+    }
+
+    // drop slots the writer may have reused while they were copied, the
+    // slot after the newest one can be half written
+    android_memory_barrier();
+    int32_t after = android_atomic_acquire_load(&mWriteCount);
+    int32_t valid = after - RING_SIZE + 1;
+    if (valid > start) {
+        int32_t dropped = valid - start;
+        if (dropped >= end - start) {
+            return 0;
+        }
+        for (int32_t i = 0; i < end - start - dropped; i++) {
+            timestamps[i] = timestamps[i + dropped];
+        }
+        start = valid;
+    }
+    return end - start;
+}
+
+void VsyncRing::getStats(Stats& stats) const
+{
+    nsecs_t timestamps[RING_SIZE];
+    nsecs_t jitter[RING_SIZE];
+    int count = getTimestamps(timestamps, RING_SIZE);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.period = nsecs_t(mPeriod);
+    stats.total = android_atomic_acquire_load(&mWriteCount);
+    stats.missed = mMissed;
+    stats.late = mLate;
+    stats.waitFailures = mWaitFailures;
+    if (!stats.period) {
+        return;
+    }
+
+    // insertion sort, there are at most RING_SIZE samples
+    int samples = 0;
+    for (int i = 1; i < count; i++) {
+        nsecs_t interval = timestamps[i] - timestamps[i - 1];
+        if (interval <= 0 || interval > stats.period * 3 / 2) {
+            // gap or missed vsync, not jitter
+            continue;
+        }
+        nsecs_t deviation = interval - stats.period;
+        if (deviation < 0)
+            deviation = -deviation;
+        int j = samples++;
+        while (j > 0 && jitter[j - 1] > deviation) {
+            jitter[j] = jitter[j - 1];
+            j--;
+        }
+        jitter[j] = deviation;
+    }
+
+    stats.samples = samples;
+    if (samples) {
+        stats.jitter50 = jitter[(samples - 1) * 50 / 100];
+        stats.jitter90 = jitter[(samples - 1) * 90 / 100];
+        stats.jitter99 = jitter[(samples - 1) * 99 / 100];
+    }
+}
+
+void VsyncRing::dump(Dump& d) const
+{
+    Stats stats;
+    getStats(stats);
+    d.append("Vsync: period %lldns, jitter p50/p90/p99 %lld/%lld/%lldns over %u intervals\n",
+             stats.period, stats.jitter50, stats.jitter90, stats.jitter99, stats.samples);
+    d.append("       total %u, missed %u, late %u, wait failures %u\n",
+             stats.total, stats.missed, stats.late, stats.waitFailures);
+}
+
+} // namespace intel
+} // namespace android
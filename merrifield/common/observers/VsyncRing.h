@@ -0,0 +1,81 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef VSYNC_RING_H
+#define VSYNC_RING_H
+
+#include <stdint.h>
+#include <Dump.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace intel {
+
+// Recent vsync timestamps of one display and pacing counters derived
+// from them. There is a single writer, the vsync observer thread, and
+// readers on any thread take a snapshot without locking.
+class VsyncRing {
+public:
+    enum {
+        // must be a power of two
+        RING_SIZE = 128,
+    };
+
+    struct Stats {
+        nsecs_t period;
+        // distribution of |interval - period|
+        nsecs_t jitter50;
+        nsecs_t jitter90;
+        nsecs_t jitter99;
+        uint32_t samples;
+        uint32_t total;
+        uint32_t missed;
+        uint32_t late;
+        uint32_t waitFailures;
+    };
+
+public:
+    VsyncRing();
+    ~VsyncRing();
+
+public:
+    // writer side
+    void add(nsecs_t timestamp, nsecs_t received);
+    void addWaitFailure();
+    // vsync was off, do not count the gap as missed vsyncs
+    void resume();
+    // running period estimate, 0 if unknown
+    nsecs_t getPeriod() const { return nsecs_t(mPeriod); }
+
+    // reader side, returns the number of timestamps copied oldest first
+    int getTimestamps(nsecs_t *timestamps, int count) const;
+    void getStats(Stats& stats) const;
+    void dump(Dump& d) const;
+
+private:
+    nsecs_t mTimestamps[RING_SIZE];
+    volatile int32_t mWriteCount;
+    nsecs_t mLastTimestamp;
+    // in ns, 32 bits so readers never see a torn value
+    volatile int32_t mPeriod;
+    volatile uint32_t mMissed;
+    volatile uint32_t mLate;
+    volatile uint32_t mWaitFailures;
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* VSYNC_RING_H */
@@ -30,6 +30,10 @@ DisplayPlane::DisplayPlane(int index, int type, int disp)
       mDataBuffers(),
       mActiveBuffers(),
       mCacheCapacity(0),
+      mUseCount(0),
+      mCacheHits(0),
+      mCacheMisses(0),
+      mCacheEvictions(0),
       mIsProtectedBuffer(false),
       mTransform(0),
       mPlaneAlpha(0),
@@ -165,10 +169,11 @@ void DisplayPlane::setPlaneAlpha(uint8_t alpha, uint32_t blending)
 bool DisplayPlane::setDataBuffer(buffer_handle_t handle)
 {
     DataBuffer *buffer;
+    BufferInfo info;
     BufferMapper *mapper;
+    uint64_t key;
     ssize_t index;
     bool ret;
-    bool isCompression;
     BufferManager *bm = Hwcomposer::getInstance().getBufferManager();
 
     RETURN_FALSE_IF_NOT_INIT();
@@ -187,42 +192,59 @@ bool DisplayPlane::setDataBuffer(buffer_handle_t handle)
     if (!mUpdateMasks)
         return true;
 
-    buffer = bm->lockDataBuffer(handle);
-    if (!buffer) {
-        ETRACE("failed to get buffer");
-        return false;
-    }
-
-    mIsProtectedBuffer = GraphicBuffer::isProtectedBuffer((GraphicBuffer*)buffer);
-    isCompression = GraphicBuffer::isCompressionBuffer((GraphicBuffer*)buffer);
+    // the key is the allocation stamp, a cached buffer carries the
+    // attributes decoded when it was mapped
+    key = bm->getBufferKey(handle);
 
     // map buffer if it's not in cache
-    index = mDataBuffers.indexOfKey(buffer->getKey());
+    index = mDataBuffers.indexOfKey(key);
     if (index < 0) {
         VTRACE("unmapped buffer, mapping...");
+        mCacheMisses++;
+        if (!bm->getBufferInfo(handle, info)) {
+            ETRACE("failed to get buffer");
+            return false;
+        }
+        // only new buffers need the shared data buffer
+        buffer = bm->lockDataBuffer(handle);
+        if (!buffer) {
+            ETRACE("failed to get buffer");
+            return false;
+        }
         mapper = mapBuffer(buffer);
+        // unlock buffer after getting mapper
+        bm->unlockDataBuffer(buffer);
+        buffer = NULL;
         if (!mapper) {
             ETRACE("failed to map buffer %p", handle);
-            bm->unlockDataBuffer(buffer);
             return false;
         }
+        index = mDataBuffers.indexOfKey(key);
+        if (index >= 0) {
+            mDataBuffers.editValueAt(index).info = info;
+        }
     } else {
         VTRACE("got mapper in saved data buffers and update source Crop");
-        mapper = mDataBuffers.valueAt(index);
+        mCacheHits++;
+        mapper = mDataBuffers.valueAt(index).mapper;
+        info = mDataBuffers.valueAt(index).info;
     }
 
+    mIsProtectedBuffer = info.isProtected();
+
     // always update source crop to mapper
     mapper->setCrop(mSrcCrop.x, mSrcCrop.y, mSrcCrop.w, mSrcCrop.h);
 
-    mapper->setIsCompression(isCompression);
-
-    // unlock buffer after getting mapper
-    bm->unlockDataBuffer(buffer);
-    buffer = NULL;
+    mapper->setIsCompression(info.isCompression());
 
     ret = setDataBuffer(*mapper);
     if (ret) {
         mCurrentDataBuffer = handle;
+        // mark it as most recently used
+        index = mDataBuffers.indexOfKey(key);
+        if (index >= 0) {
+            mDataBuffers.editValueAt(index).lastUse = ++mUseCount;
+        }
         // update active buffers
         updateActiveBuffers(mapper);
     }
@@ -233,9 +255,9 @@ BufferMapper* DisplayPlane::mapBuffer(DataBuffer *buffer)
 {
     BufferManager *bm = Hwcomposer::getInstance().getBufferManager();
 
-    // invalidate buffer cache  if cache is full
+    // evict the least recently used buffer if cache is full
     if ((int)mDataBuffers.size() >= mCacheCapacity) {
-        invalidateBufferCache();
+        evictDataBuffer();
     }
 
     BufferMapper *mapper = bm->map(*buffer);
@@ -245,7 +267,10 @@ BufferMapper* DisplayPlane::mapBuffer(DataBuffer *buffer)
     }
 
     // add it to data buffers
-    ssize_t index = mDataBuffers.add(buffer->getKey(), mapper);
+    CachedBuffer cached;
+    cached.mapper = mapper;
+    cached.lastUse = mUseCount;
+    ssize_t index = mDataBuffers.add(buffer->getKey(), cached);
     if (index < 0) {
         ETRACE("failed to add mapper");
         bm->unmap(mapper);
@@ -255,6 +280,41 @@ BufferMapper* DisplayPlane::mapBuffer(DataBuffer *buffer)
     return mapper;
 }
 
+void DisplayPlane::evictDataBuffer()
+{
+    BufferManager *bm = Hwcomposer::getInstance().getBufferManager();
+    ssize_t victim = -1;
+    bool victimActive = true;
+
+    // prefer the least recently used buffer which is not on screen or
+    // queued in the display pipeline, active buffers hold their own
+    // reference so evicting one of them is still safe
+    for (size_t i = 0; i < mDataBuffers.size(); i++) {
+        const CachedBuffer& cached = mDataBuffers.valueAt(i);
+        bool active = findActiveBuffer(cached.mapper) >= 0;
+        if (victim < 0 ||
+            (victimActive && !active) ||
+            (victimActive == active &&
+             (int32_t)(cached.lastUse - mDataBuffers.valueAt(victim).lastUse) < 0)) {
+            victim = i;
+            victimActive = active;
+        }
+    }
+
+    if (victim < 0) {
+        return;
+    }
+
+    BufferMapper *mapper = mDataBuffers.valueAt(victim).mapper;
+    VTRACE("evicting buffer %#llx", mapper->getKey());
+    if (mCurrentDataBuffer == mapper->getHandle()) {
+        mCurrentDataBuffer = 0;
+    }
+    bm->unmap(mapper);
+    mDataBuffers.removeItemsAt(victim);
+    mCacheEvictions++;
+}
+
 int DisplayPlane::findActiveBuffer(BufferMapper *mapper)
 {
     for (size_t i = 0; i < mActiveBuffers.size(); i++) {
@@ -317,7 +377,7 @@ void DisplayPlane::invalidateBufferCache()
     RETURN_VOID_IF_NOT_INIT();
 
     for (size_t i = 0; i < mDataBuffers.size(); i++) {
-        mapper = mDataBuffers.valueAt(i);
+        mapper = mDataBuffers.valueAt(i).mapper;
         bm->unmap(mapper);
     }
 
@@ -380,5 +440,13 @@ int DisplayPlane::getZOrder() const
     return mZOrder;
 }
 
+void DisplayPlane::dump(Dump& d)
+{
+    d.append("   %2d  |  %2d  |   %2d   | %4d/%-4d | %10u | %10u | %10u\n",
+             mIndex, mType, mDevice,
+             mDataBuffers.size(), mCacheCapacity,
+             mCacheHits, mCacheMisses, mCacheEvictions);
+}
+
 } // namespace intel
 } // namespace android
@@ -25,6 +25,9 @@ DisplayPlaneManager::DisplayPlaneManager()
       mPrimaryPlaneCount(DEFAULT_PRIMARY_PLANE_COUNT),
       mSpritePlaneCount(0),
       mOverlayPlaneCount(0),
+      mOverlayLock(),
+      mOverlayCondition(),
+      mOverlayWaiters(0),
       mInitialized(false)
 {
     int i;
@@ -320,6 +323,35 @@ bool DisplayPlaneManager::isOverlayPlanesDisabled()
     return true;
 }
 
+bool DisplayPlaneManager::waitForOverlayPlanesDisabled(nsecs_t timeout)
+{
+    const nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + timeout;
+    bool disabled;
+
+    Mutex::Autolock _l(mOverlayLock);
+    mOverlayWaiters++;
+    while (!(disabled = isOverlayPlanesDisabled())) {
+        nsecs_t remaining = deadline - systemTime(SYSTEM_TIME_MONOTONIC);
+        if (remaining <= 0) {
+            break;
+        }
+        mOverlayCondition.waitRelative(mOverlayLock, remaining);
+    }
+    mOverlayWaiters--;
+    return disabled;
+}
+
+void DisplayPlaneManager::onFlipComplete()
+{
+    RETURN_VOID_IF_NOT_INIT();
+
+    // the plane state is only queried while someone waits for it
+    Mutex::Autolock _l(mOverlayLock);
+    if (mOverlayWaiters && isOverlayPlanesDisabled()) {
+        mOverlayCondition.broadcast();
+    }
+}
+
 void DisplayPlaneManager::dump(Dump& d)
 {
     d.append("Display Plane Manager state:\n");
@@ -342,6 +374,18 @@ void DisplayPlaneManager::dump(Dump& d)
              mPlaneCount[DisplayPlane::PLANE_CURSOR],
              mFreePlanes[DisplayPlane::PLANE_CURSOR],
              mReclaimedPlanes[DisplayPlane::PLANE_CURSOR]);
+
+    d.append("\n Data buffer cache:\n");
+    d.append(" INDEX | TYPE | DEVICE |   USED    |    HITS    |   MISSES   | EVICTIONS\n");
+    d.append("-------+------+--------+-----------+------------+------------+-----------\n");
+    for (int i = 0; i < DisplayPlane::PLANE_MAX; i++) {
+        for (size_t j = 0; j < mPlanes[i].size(); j++) {
+            DisplayPlane *plane = mPlanes[i].itemAt(j);
+            if (plane) {
+                plane->dump(d);
+            }
+        }
+    }
 }
 
 } // namespace intel
@@ -0,0 +1,223 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <HwcTrace.h>
+#include <utils/Mutex.h>
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
+#include <FrameTimings.h>
+
+namespace android {
+namespace intel {
+
+enum {
+    // four buckets per power of two microseconds, up to about a second
+    SUB_BUCKET_BITS = 2,
+    SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+    BUCKET_COUNT = 20 * SUB_BUCKETS,
+    FRAME_RING_SIZE = 16,
+    // frames between two checks of the clear property
+    CLEAR_CHECK_INTERVAL = 64,
+};
+
+// updated with atomics so that the timers take no lock, a dump racing
+// with them may be a sample off
+struct StageStats {
+    volatile int32_t count;
+    volatile int32_t maxUs;
+    volatile int32_t buckets[BUCKET_COUNT];
+};
+
+static const char *sStageNames[FrameTimings::STAGE_COUNT] = {
+    "prepare",
+    "  analyze",
+    "  reclaim planes",
+    "  build layer lists",
+    "  assign planes",
+    "commit",
+    "  flip",
+    "  acquire fences",
+    "  post",
+};
+
+// short names for the frame ring columns
+static const char *sStageTags[FrameTimings::STAGE_COUNT] = {
+    "PREP", "ANLZ", "RCLM", "BUILD", "ASGN", "CMMT", "FLIP", "FENCE", "POST",
+};
+
+// guards the frame ring, the clear property and dumps, never taken by
+// the stage timers
+static Mutex sLock;
+static StageStats sStats[FrameTimings::STAGE_COUNT];
+static volatile int32_t sCurrentFrame[FrameTimings::STAGE_COUNT];
+static uint32_t sFrameRing[FRAME_RING_SIZE][FrameTimings::STAGE_COUNT];
+static uint32_t sFrameCount;
+static char sClearValue[PROPERTY_VALUE_MAX];
+
+static inline int getBucket(uint32_t us)
+{
+    if (us < SUB_BUCKETS) {
+        return us;
+    }
+
+    int msb = 31 - __builtin_clz(us);
+    int sub = (us >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    int bucket = (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+}
+
+// exclusive upper bound of a bucket in microseconds
+static inline uint32_t getBucketLimit(int bucket)
+{
+    if (bucket < SUB_BUCKETS) {
+        return bucket + 1;
+    }
+
+    int shift = bucket / SUB_BUCKETS - 1;
+    int sub = bucket % SUB_BUCKETS;
+    return (uint32_t)(SUB_BUCKETS + sub + 1) << shift;
+}
+
+static uint32_t getPercentile(const StageStats& stats, uint32_t percent)
+{
+    uint32_t maxUs = (uint32_t)stats.maxUs;
+    uint64_t target = ((uint64_t)(uint32_t)stats.count * percent + 99) / 100;
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        total += (uint32_t)stats.buckets[i];
+        if (total >= target) {
+            uint32_t limit = getBucketLimit(i);
+            return limit < maxUs ? limit : maxUs;
+        }
+    }
+    return maxUs;
+}
+
+static void clearLocked()
+{
+    for (int i = 0; i < FrameTimings::STAGE_COUNT; i++) {
+        StageStats& stats = sStats[i];
+        android_atomic_release_store(0, &stats.count);
+        android_atomic_release_store(0, &stats.maxUs);
+        for (int j = 0; j < BUCKET_COUNT; j++) {
+            android_atomic_release_store(0, &stats.buckets[j]);
+        }
+        android_atomic_release_store(0, &sCurrentFrame[i]);
+    }
+    memset(sFrameRing, 0, sizeof(sFrameRing));
+    sFrameCount = 0;
+}
+
+void FrameTimings::record(int stage, nsecs_t duration)
+{
+    if (stage < 0 || stage >= STAGE_COUNT || duration < 0) {
+        return;
+    }
+
+    nsecs_t us = duration / 1000;
+    uint32_t value = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+
+    StageStats& stats = sStats[stage];
+    android_atomic_inc(&stats.buckets[getBucket(value)]);
+    android_atomic_inc(&stats.count);
+    int32_t maxUs;
+    do {
+        maxUs = stats.maxUs;
+        if ((uint32_t)maxUs >= value) {
+            break;
+        }
+    } while (android_atomic_release_cas(maxUs, (int32_t)value, &stats.maxUs));
+    android_atomic_add((int32_t)value, &sCurrentFrame[stage]);
+}
+
+void FrameTimings::beginFrame()
+{
+    bool checkClear;
+    {
+        Mutex::Autolock _l(sLock);
+        uint32_t *frame = sFrameRing[sFrameCount % FRAME_RING_SIZE];
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            // and with zero swaps the time out atomically
+            frame[i] = (uint32_t)android_atomic_and(0, &sCurrentFrame[i]);
+        }
+        checkClear = (++sFrameCount % CLEAR_CHECK_INTERVAL) == 0;
+    }
+
+    if (!checkClear) {
+        return;
+    }
+
+    // any new value of the property clears the timings
+    char prop[PROPERTY_VALUE_MAX];
+    if (property_get("debug.hwc.timings.clear", prop, "") <= 0) {
+        return;
+    }
+
+    Mutex::Autolock _l(sLock);
+    if (strcmp(prop, sClearValue)) {
+        strcpy(sClearValue, prop);
+        clearLocked();
+        ITRACE("frame timings cleared");
+    }
+}
+
+void FrameTimings::clear()
+{
+    Mutex::Autolock _l(sLock);
+    clearLocked();
+}
+
+void FrameTimings::dump(Dump& d)
+{
+    Mutex::Autolock _l(sLock);
+
+    d.append("Frame timings (us):\n");
+    d.append("------------------------------------------------------------------\n");
+    d.append("        STAGE         |   COUNT |    P50 |    P95 |    P99 |    MAX\n");
+    d.append("----------------------+---------+--------+--------+--------+-------\n");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const StageStats& stats = sStats[i];
+        uint32_t count = (uint32_t)android_atomic_acquire_load(&stats.count);
+        if (!count) {
+            continue;
+        }
+        d.append(" %-20s | %7u | %6u | %6u | %6u | %6u\n",
+                 sStageNames[i], count,
+                 getPercentile(stats, 50),
+                 getPercentile(stats, 95),
+                 getPercentile(stats, 99),
+                 (uint32_t)stats.maxUs);
+    }
+
+    uint32_t frames = sFrameCount < (uint32_t)FRAME_RING_SIZE ? sFrameCount : (uint32_t)FRAME_RING_SIZE;
+    d.append("  last %u frames:\n ", frames);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        d.append(" %6s", sStageTags[i]);
+    }
+    d.append("\n");
+    for (uint32_t i = sFrameCount - frames; i < sFrameCount; i++) {
+        const uint32_t *frame = sFrameRing[i % FRAME_RING_SIZE];
+        d.append(" ");
+        for (int j = 0; j < STAGE_COUNT; j++) {
+            d.append(" %6u", frame[j]);
+        }
+        d.append("\n");
+    }
+}
+
+} // namespace intel
+} // namespace android
@@ -0,0 +1,76 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef FRAME_TIMINGS_H_
+#define FRAME_TIMINGS_H_
+
+#include <stdint.h>
+#include <utils/Timers.h>
+#include <Dump.h>
+
+namespace android {
+namespace intel {
+
+// Process wide timings of the prepare and commit stages. Every stage keeps
+// a latency histogram, and the stage times of the last frames are kept in
+// a ring. Setting debug.hwc.timings.clear to a new value clears both.
+class FrameTimings {
+public:
+    enum Stage {
+        STAGE_PREPARE = 0,
+        STAGE_ANALYZE,
+        STAGE_RECLAIM,
+        STAGE_BUILD_LAYERS,
+        STAGE_ASSIGN_PLANES,
+        STAGE_COMMIT,
+        STAGE_FLIP,
+        STAGE_FENCE_WAIT,
+        STAGE_POST,
+        STAGE_COUNT,
+    };
+
+public:
+    // a stage may run several times in a frame, its times add up
+    static void record(int stage, nsecs_t duration);
+    // called as a new frame is prepared
+    static void beginFrame();
+    static void clear();
+    static void dump(Dump& d);
+};
+
+// Records the time from its creation to stop() or the end of its scope.
+class StageTimer {
+public:
+    StageTimer(int stage)
+        : mStage(stage),
+          mStart(systemTime(SYSTEM_TIME_MONOTONIC)) {}
+    ~StageTimer() { stop(); }
+
+    void stop() {
+        if (mStart) {
+            FrameTimings::record(mStage, systemTime(SYSTEM_TIME_MONOTONIC) - mStart);
+            mStart = 0;
+        }
+    }
+
+private:
+    int mStage;
+    nsecs_t mStart;
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* FRAME_TIMINGS_H_ */
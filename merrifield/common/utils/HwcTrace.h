@@ -51,6 +51,29 @@ extern "C" {
 #endif
 
 
+// Binary event tracing, cheap enough to stay enabled in release builds.
+// Events are declared in HwcTraceEvents.h and take up to four integers.
+#ifdef __cplusplus
+#include <HwcTraceBuffer.h>
+
+#define HTRACE_RECORD(ev, phase, ...) \
+do { \
+    if (android::intel::HwcTraceBuffer::isEnabled()) \
+        android::intel::HwcTraceBuffer::record(android::intel::HWC_TRACE_##ev, \
+                                               phase, ##__VA_ARGS__); \
+} while (0)
+
+#define HTRACE_BEGIN(ev, ...)       HTRACE_RECORD(ev, HWC_TRACE_PHASE_BEGIN, ##__VA_ARGS__)
+#define HTRACE_END(ev)              HTRACE_RECORD(ev, HWC_TRACE_PHASE_END)
+#define HTRACE_INSTANT(ev, ...)     HTRACE_RECORD(ev, HWC_TRACE_PHASE_INSTANT, ##__VA_ARGS__)
+#define HTRACE_COUNTER(ev, value)   HTRACE_RECORD(ev, HWC_TRACE_PHASE_COUNTER, value)
+
+// Begins an event which ends when the enclosing scope exits
+#define HTRACE_SCOPE(ev, ...) \
+    android::intel::HwcTraceScope __htraceScope(android::intel::HWC_TRACE_##ev, ##__VA_ARGS__)
+#endif
+
+
 
 // Helper to abort the execution if object is not initialized.
 // This should never happen if the rules below are followed during design:
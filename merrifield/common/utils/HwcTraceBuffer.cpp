@@ -0,0 +1,295 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <HwcTrace.h>
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
+#include <Dump.h>
+#include <HwcTraceBuffer.h>
+
+namespace android {
+namespace intel {
+
+enum {
+    MAX_THREADS = 16,
+    // records per thread, must be a power of two
+    RING_SIZE = 4096,
+};
+
+struct ThreadRing {
+    // records ever written, wraps modulo 2^32
+    volatile uint32_t writeCount;
+    // cleared when the owning thread exits, the ring may then be reused
+    volatile int32_t attached;
+    int32_t tid;
+    char name[HWC_TRACE_THREAD_NAME_SIZE];
+    HwcTraceRecord records[RING_SIZE];
+};
+
+static inline uint32_t loadCount(const ThreadRing *ring)
+{
+    return (uint32_t)android_atomic_acquire_load(
+            (volatile int32_t *)&ring->writeCount);
+}
+
+// thread specific value of threads which found no free ring
+#define NO_RING ((ThreadRing *)-1)
+
+static const HwcTraceEventInfo sEventInfo[HWC_TRACE_EVENT_COUNT] = {
+#define HWC_TRACE_EVENT(id, name, format) { HWC_TRACE_##id, name, format },
+    HWC_TRACE_EVENT_LIST
+#undef HWC_TRACE_EVENT
+};
+
+// guards ring allocation against snapshots
+static Mutex sLock;
+static ThreadRing *sRings[MAX_THREADS];
+static pthread_key_t sRingKey;
+static pthread_once_t sKeyOnce = PTHREAD_ONCE_INIT;
+static bool sKeyCreated = false;
+// records of threads without a ring
+static volatile int32_t sDropped;
+
+volatile int32_t HwcTraceBuffer::sEnabled = 0;
+
+static void detachThread(void *value)
+{
+    ThreadRing *ring = (ThreadRing *)value;
+    if (ring && ring != NO_RING) {
+        android_atomic_release_store(0, &ring->attached);
+    }
+}
+
+static void createKey()
+{
+    if (pthread_key_create(&sRingKey, detachThread)) {
+        ETRACE("failed to create trace key");
+        return;
+    }
+    sKeyCreated = true;
+}
+
+static ThreadRing* attachThread()
+{
+    Mutex::Autolock _l(sLock);
+
+    // prefer a new ring so that the records of exited threads survive
+    ThreadRing *ring = NULL;
+    for (int i = 0; i < MAX_THREADS && !ring; i++) {
+        if (!sRings[i]) {
+            sRings[i] = (ThreadRing *)calloc(1, sizeof(ThreadRing));
+            ring = sRings[i];
+        }
+    }
+    for (int i = 0; i < MAX_THREADS && !ring; i++) {
+        if (sRings[i] && !android_atomic_acquire_load(&sRings[i]->attached)) {
+            ring = sRings[i];
+            ring->writeCount = 0;
+        }
+    }
+
+    if (!ring) {
+        WTRACE("no trace ring left for thread %d", gettid());
+        pthread_setspecific(sRingKey, NO_RING);
+        return NO_RING;
+    }
+
+    ring->attached = 1;
+    ring->tid = gettid();
+    memset(ring->name, 0, sizeof(ring->name));
+    prctl(PR_GET_NAME, (unsigned long)ring->name, 0, 0, 0);
+    ring->name[HWC_TRACE_THREAD_NAME_SIZE - 1] = 0;
+    pthread_setspecific(sRingKey, ring);
+    return ring;
+}
+
+// copies the records still in the ring, oldest first, at most RING_SIZE
+static uint32_t snapshotRing(const ThreadRing *ring, HwcTraceRecord *records)
+{
+    uint32_t end = loadCount(ring);
+    uint32_t count = end < uint32_t(RING_SIZE) ? end : uint32_t(RING_SIZE);
+    uint32_t start = end - count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        records[i] = ring->records[(start + i) & (RING_SIZE - 1)];
+    }
+
+    // drop records the owner may have overwritten while they were copied,
+    // the record being written at 'after' may already be torn
+    android_memory_barrier();
+    uint32_t advanced = loadCount(ring) - end;
+    if (advanced >= uint32_t(RING_SIZE)) {
+        return 0;
+    }
+    uint32_t reach = advanced + 1 + count;
+    if (reach > uint32_t(RING_SIZE)) {
+        uint32_t dropped = reach - RING_SIZE;
+        if (dropped >= count) {
+            return 0;
+        }
+        memmove(records, records + dropped,
+                (count - dropped) * sizeof(HwcTraceRecord));
+        count -= dropped;
+    }
+    return count;
+}
+
+static bool writeAll(int fd, const void *data, size_t size)
+{
+    const char *p = (const char *)data;
+    while (size) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+void HwcTraceBuffer::initialize()
+{
+    char prop[PROPERTY_VALUE_MAX];
+    if (property_get("hwc.trace.enable", prop, "1") > 0 && !atoi(prop)) {
+        ITRACE("binary trace disabled");
+        return;
+    }
+
+    pthread_once(&sKeyOnce, createKey);
+    if (sKeyCreated) {
+        android_atomic_release_store(1, &sEnabled);
+    }
+}
+
+void HwcTraceBuffer::record(int event, int phase,
+                            int32_t arg0, int32_t arg1,
+                            int32_t arg2, int32_t arg3)
+{
+    ThreadRing *ring = (ThreadRing *)pthread_getspecific(sRingKey);
+    if (!ring) {
+        ring = attachThread();
+    }
+    if (ring == NO_RING) {
+        android_atomic_inc(&sDropped);
+        return;
+    }
+
+    uint32_t count = ring->writeCount;
+    HwcTraceRecord& r = ring->records[count & (RING_SIZE - 1)];
+    r.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    r.args[0] = arg0;
+    r.args[1] = arg1;
+    r.args[2] = arg2;
+    r.args[3] = arg3;
+    r.event = uint16_t(event);
+    r.phase = uint16_t(phase);
+    r.reserved = 0;
+    android_atomic_release_store(int32_t(count + 1),
+                                 (volatile int32_t *)&ring->writeCount);
+}
+
+bool HwcTraceBuffer::writeFile(const char *path)
+{
+    HwcTraceRecord *records =
+        (HwcTraceRecord *)malloc(RING_SIZE * sizeof(HwcTraceRecord));
+    if (!records) {
+        ETRACE("failed to allocate trace snapshot");
+        return false;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ETRACE("failed to open %s, error: %s", path, strerror(errno));
+        free(records);
+        return false;
+    }
+
+    HwcTraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HWC_TRACE_MAGIC;
+    header.version = HWC_TRACE_VERSION;
+    header.pid = getpid();
+    header.eventCount = HWC_TRACE_EVENT_COUNT;
+    header.recordSize = sizeof(HwcTraceRecord);
+    for (int i = 0; i < MAX_THREADS; i++) {
+        if (sRings[i]) {
+            header.threadCount++;
+        }
+    }
+
+    bool ret = writeAll(fd, &header, sizeof(header)) &&
+               writeAll(fd, sEventInfo, sizeof(sEventInfo));
+
+    for (int i = 0; i < MAX_THREADS && ret; i++) {
+        const ThreadRing *ring = sRings[i];
+        if (!ring) {
+            continue;
+        }
+
+        HwcTraceThreadInfo info;
+        memset(&info, 0, sizeof(info));
+        info.tid = ring->tid;
+        memcpy(info.name, ring->name, sizeof(info.name));
+        info.recordCount = snapshotRing(ring, records);
+        ret = writeAll(fd, &info, sizeof(info)) &&
+              writeAll(fd, records, info.recordCount * sizeof(HwcTraceRecord));
+    }
+
+    if (!ret) {
+        ETRACE("failed to write %s, error: %s", path, strerror(errno));
+    }
+    close(fd);
+    free(records);
+    return ret;
+}
+
+void HwcTraceBuffer::dump(Dump& d)
+{
+    Mutex::Autolock _l(sLock);
+
+    d.append("Binary trace: %s, %d records dropped\n",
+             isEnabled() ? "enabled" : "disabled",
+             android_atomic_acquire_load(&sDropped));
+    for (int i = 0; i < MAX_THREADS; i++) {
+        const ThreadRing *ring = sRings[i];
+        if (!ring) {
+            continue;
+        }
+        d.append("  tid %5d %-16s %10u records%s\n",
+                 ring->tid, ring->name, loadCount(ring),
+                 android_atomic_acquire_load(&ring->attached) ? "" : " (exited)");
+    }
+
+    char path[PROPERTY_VALUE_MAX];
+    if (property_get("debug.hwc.trace.file", path, "") > 0) {
+        d.append("  snapshot %s %s\n", writeFile(path) ? "written to" : "failed on", path);
+    }
+}
+
+} // namespace intel
+} // namespace android
@@ -0,0 +1,69 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef HWC_TRACE_BUFFER_H
+#define HWC_TRACE_BUFFER_H
+
+#include <stdint.h>
+#include <HwcTraceFormat.h>
+#include <HwcTraceEvents.h>
+
+namespace android {
+namespace intel {
+
+class Dump;
+
+// Binary event trace. Every tracing thread owns a ring of fixed size
+// records which only it writes, so recording takes no lock and does no
+// formatting. The rings are snapshotted to a file from the hwc dump when
+// debug.hwc.trace.file names one, see tools/hwc_trace_decode.
+class HwcTraceBuffer {
+public:
+    // reads hwc.trace.enable, records are dropped until this is called
+    static void initialize();
+    static inline bool isEnabled() { return sEnabled != 0; }
+    static void record(int event, int phase,
+                       int32_t arg0 = 0, int32_t arg1 = 0,
+                       int32_t arg2 = 0, int32_t arg3 = 0);
+    static void dump(Dump& d);
+
+private:
+    static bool writeFile(const char *path);
+
+private:
+    static volatile int32_t sEnabled;
+};
+
+// Records the begin of an event on creation and its end on destruction.
+class HwcTraceScope {
+public:
+    HwcTraceScope(int event, int32_t arg0 = 0, int32_t arg1 = 0)
+        : mEvent(event) {
+        if (HwcTraceBuffer::isEnabled())
+            HwcTraceBuffer::record(event, HWC_TRACE_PHASE_BEGIN, arg0, arg1);
+    }
+    ~HwcTraceScope() {
+        if (HwcTraceBuffer::isEnabled())
+            HwcTraceBuffer::record(mEvent, HWC_TRACE_PHASE_END);
+    }
+
+private:
+    int mEvent;
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* HWC_TRACE_BUFFER_H */
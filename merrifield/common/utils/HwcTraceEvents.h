@@ -0,0 +1,54 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef HWC_TRACE_EVENTS_H
+#define HWC_TRACE_EVENTS_H
+
+// Events of the binary trace, HWC_TRACE_EVENT(id, name, format). The
+// format describes the integer arguments of begin, instant and counter
+// records; end records carry no arguments. Ids are only stable within a
+// build, snapshots carry this table for the decoder.
+#define HWC_TRACE_EVENT_LIST \
+    HWC_TRACE_EVENT(PREPARE,        "prepare",          "displays=%d") \
+    HWC_TRACE_EVENT(BUILD_LAYERS,   "buildLayers",      "disp=%d layers=%d") \
+    HWC_TRACE_EVENT(DEVICE_PREPARE, "devicePrepare",    "disp=%d layers=%d") \
+    HWC_TRACE_EVENT(COMMIT,         "commit",           "displays=%d") \
+    HWC_TRACE_EVENT(QUEUE_FRAME,    "queueFrame",       "layers=%d") \
+    HWC_TRACE_EVENT(FENCE_WAIT,     "fenceWait",        "layers=%d") \
+    HWC_TRACE_EVENT(LATE_LAYER,     "lateLayer",        "layer=%d fence=%d") \
+    HWC_TRACE_EVENT(REPOST,         "repost",           "layer=%d") \
+    HWC_TRACE_EVENT(ALIGN_POST,     "alignPost",        "delay_us=%d") \
+    HWC_TRACE_EVENT(POST,           "post",             "layers=%d") \
+    HWC_TRACE_EVENT(PIPE_LATCH,     "pipeLatch",        "disp=%d post=%d vsync=%d") \
+    HWC_TRACE_EVENT(LAYER_COUNT,    "layers",           "%d") \
+    HWC_TRACE_EVENT(VSYNC,          "vsync",            "disp=%d") \
+    HWC_TRACE_EVENT(VSYNC_DROPPED,  "vsyncDropped",     "disp=%d") \
+    HWC_TRACE_EVENT(HOTPLUG,        "hotplug",          "disp=%d connected=%d") \
+    HWC_TRACE_EVENT(INVALIDATE,     "invalidate",       "")
+
+namespace android {
+namespace intel {
+
+enum HwcTraceEvent {
+#define HWC_TRACE_EVENT(id, name, format) HWC_TRACE_##id,
+    HWC_TRACE_EVENT_LIST
+#undef HWC_TRACE_EVENT
+    HWC_TRACE_EVENT_COUNT,
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* HWC_TRACE_EVENTS_H */
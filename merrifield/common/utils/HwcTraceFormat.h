@@ -0,0 +1,74 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef HWC_TRACE_FORMAT_H
+#define HWC_TRACE_FORMAT_H
+
+#include <stdint.h>
+
+// Layout of a binary trace snapshot. The file is self describing so the
+// host decoder does not depend on the event list of a given build:
+//
+//   HwcTraceFileHeader
+//   HwcTraceEventInfo           x eventCount
+//   { HwcTraceThreadInfo, HwcTraceRecord x recordCount } x threadCount
+//
+// All fields are in the byte order of the device.
+
+#define HWC_TRACE_MAGIC                 0x54435748  /* "HWCT" */
+#define HWC_TRACE_VERSION               1
+#define HWC_TRACE_NAME_SIZE             32
+#define HWC_TRACE_FORMAT_SIZE           64
+#define HWC_TRACE_THREAD_NAME_SIZE      16
+#define HWC_TRACE_ARG_COUNT             4
+
+// record phases, named after the Chrome trace event phases
+#define HWC_TRACE_PHASE_BEGIN           'B'
+#define HWC_TRACE_PHASE_END             'E'
+#define HWC_TRACE_PHASE_INSTANT         'i'
+#define HWC_TRACE_PHASE_COUNTER         'C'
+
+struct HwcTraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint32_t eventCount;
+    uint32_t threadCount;
+    uint32_t recordSize;
+};
+
+struct HwcTraceEventInfo {
+    uint32_t id;
+    char name[HWC_TRACE_NAME_SIZE];
+    // printf style, only integer conversions of the record arguments
+    char format[HWC_TRACE_FORMAT_SIZE];
+};
+
+struct HwcTraceThreadInfo {
+    int32_t tid;
+    uint32_t recordCount;
+    char name[HWC_TRACE_THREAD_NAME_SIZE];
+};
+
+struct HwcTraceRecord {
+    // CLOCK_MONOTONIC in ns
+    int64_t timestamp;
+    int32_t args[HWC_TRACE_ARG_COUNT];
+    uint16_t event;
+    uint16_t phase;
+    uint32_t reserved;
+};
+
+#endif /* HWC_TRACE_FORMAT_H */
@@ -0,0 +1,149 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <HwcTrace.h>
+#include <utils/Mutex.h>
+#include <MemoryAccounting.h>
+
+namespace android {
+namespace intel {
+
+struct MemoryUsage {
+    uint64_t bytes;
+    uint64_t peakBytes;
+    uint32_t count;
+    uint32_t peakCount;
+};
+
+// one extra slot for objects shared by displays
+enum {
+    SLOT_COUNT = MemoryAccounting::DISPLAY_COUNT + 1,
+};
+
+static const char *sCategoryNames[MemoryAccounting::MEM_CATEGORY_COUNT] = {
+    "GTT mapping",
+    "TTM mapping",
+    "VA surface",
+    "overlay back buffer",
+    "rotation buffer",
+    "WiDi CSC buffer",
+    "WiDi upscale buffer",
+};
+
+static const char *sSlotNames[SLOT_COUNT] = {
+    "primary",
+    "external",
+    "virtual",
+    "shared",
+};
+
+static Mutex sLock;
+static MemoryUsage sUsage[MemoryAccounting::MEM_CATEGORY_COUNT][SLOT_COUNT];
+static MemoryUsage sMapped;
+static MemoryUsage sAllocated;
+
+static inline MemoryUsage* getUsage(int category, int disp)
+{
+    if (category < 0 || category >= MemoryAccounting::MEM_CATEGORY_COUNT) {
+        ETRACE("invalid category %d", category);
+        return NULL;
+    }
+    if (disp < 0 || disp >= MemoryAccounting::DISPLAY_COUNT) {
+        disp = MemoryAccounting::DISPLAY_COUNT;
+    }
+    return &sUsage[category][disp];
+}
+
+static inline MemoryUsage& getTotal(int category)
+{
+    return category < MemoryAccounting::MEM_MAPPING_COUNT ? sMapped : sAllocated;
+}
+
+static inline void addUsage(MemoryUsage& usage, uint64_t bytes)
+{
+    usage.bytes += bytes;
+    usage.count++;
+    if (usage.bytes > usage.peakBytes)
+        usage.peakBytes = usage.bytes;
+    if (usage.count > usage.peakCount)
+        usage.peakCount = usage.count;
+}
+
+static inline void removeUsage(MemoryUsage& usage, uint64_t bytes)
+{
+    if (!usage.count || usage.bytes < bytes) {
+        WTRACE("unbalanced memory accounting");
+        usage.bytes = bytes > usage.bytes ? 0 : usage.bytes - bytes;
+        usage.count = usage.count ? usage.count - 1 : 0;
+        return;
+    }
+    usage.bytes -= bytes;
+    usage.count--;
+}
+
+void MemoryAccounting::add(int category, int disp, uint64_t bytes)
+{
+    Mutex::Autolock _l(sLock);
+    MemoryUsage *usage = getUsage(category, disp);
+    if (!usage)
+        return;
+    addUsage(*usage, bytes);
+    addUsage(getTotal(category), bytes);
+}
+
+void MemoryAccounting::remove(int category, int disp, uint64_t bytes)
+{
+    Mutex::Autolock _l(sLock);
+    MemoryUsage *usage = getUsage(category, disp);
+    if (!usage)
+        return;
+    removeUsage(*usage, bytes);
+    removeUsage(getTotal(category), bytes);
+}
+
+static void dumpSection(Dump& d, int first, int last, const char *total,
+                        const MemoryUsage& usage)
+{
+    for (int i = first; i < last; i++) {
+        for (int j = 0; j < SLOT_COUNT; j++) {
+            const MemoryUsage& u = sUsage[i][j];
+            if (!u.peakCount)
+                continue;
+            d.append(" %-20s | %-8s | %5u (%5u) | %7llu (%7llu)\n",
+                     sCategoryNames[i], sSlotNames[j],
+                     u.count, u.peakCount,
+                     u.bytes >> 10, u.peakBytes >> 10);
+        }
+    }
+    d.append(" %-20s | %-8s | %5u (%5u) | %7llu (%7llu)\n",
+             total, "", usage.count, usage.peakCount,
+             usage.bytes >> 10, usage.peakBytes >> 10);
+}
+
+void MemoryAccounting::dump(Dump& d)
+{
+    Mutex::Autolock _l(sLock);
+
+    d.append("Memory accounting:\n");
+    d.append("-------------------------------------------------------------\n");
+    d.append("       CATEGORY       | DISPLAY  | COUNT (PEAK) |     KB (PEAK)\n");
+    d.append("----------------------+----------+--------------+------------------\n");
+    dumpSection(d, 0, MEM_MAPPING_COUNT, "total mapped", sMapped);
+    d.append("----------------------+----------+--------------+------------------\n");
+    dumpSection(d, MEM_MAPPING_COUNT, MEM_CATEGORY_COUNT, "total allocated", sAllocated);
+}
+
+} // namespace intel
+} // namespace android
@@ -0,0 +1,61 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef MEMORY_ACCOUNTING_H_
+#define MEMORY_ACCOUNTING_H_
+
+#include <stdint.h>
+#include <Dump.h>
+
+namespace android {
+namespace intel {
+
+// Process wide registry of memory and mappings held by the HWC.
+// Allocators report every object they create and destroy, with its size
+// in bytes and the display it serves. Mappings only make existing buffers
+// visible to the hardware, so they are totalled apart from allocations.
+class MemoryAccounting {
+public:
+    enum Category {
+        // mappings of buffers owned by someone else
+        MEM_GTT_MAPPING = 0,
+        MEM_TTM_MAPPING,
+        MEM_VA_SURFACE,
+        // memory allocated by the HWC
+        MEM_OVERLAY_BACK_BUFFER,
+        MEM_ROTATION_BUFFER,
+        MEM_WIDI_CSC_BUFFER,
+        MEM_WIDI_UPSCALE_BUFFER,
+        MEM_CATEGORY_COUNT,
+        MEM_MAPPING_COUNT = MEM_OVERLAY_BACK_BUFFER,
+    };
+
+    enum {
+        // object is not bound to a single display
+        DISPLAY_SHARED = -1,
+        // primary, external and virtual
+        DISPLAY_COUNT = 3,
+    };
+
+public:
+    static void add(int category, int disp, uint64_t bytes);
+    static void remove(int category, int disp, uint64_t bytes);
+    static void dump(Dump& d);
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* MEMORY_ACCOUNTING_H_ */
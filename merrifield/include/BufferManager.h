@@ -18,9 +18,13 @@
 
 #include <Dump.h>
 #include <DataBuffer.h>
+#include <GraphicBuffer.h>
 #include <BufferMapper.h>
 #include <BufferCache.h>
+#include <SimpleThread.h>
 #include <utils/Mutex.h>
+#include <utils/Condition.h>
+#include <utils/KeyedVector.h>
 
 namespace android {
 namespace intel {
@@ -43,15 +47,30 @@ public:
     DataBuffer* lockDataBuffer(buffer_handle_t handle);
     void unlockDataBuffer(DataBuffer *buffer);
 
+    // alternative to lockDataBuffer for callers which only read buffer
+    // attributes, can be called from any thread without locking
+    bool getBufferInfo(buffer_handle_t handle, BufferInfo& info);
+    // read the key of a buffer and nothing else, it changes when the
+    // handle is reused for a new allocation
+    virtual uint64_t getBufferKey(buffer_handle_t handle) = 0;
+
     // get and put interfaces are deprecated
     // use lockDataBuffer and unlockDataBuffer instead
     DataBuffer* get(buffer_handle_t handle);
     void put(DataBuffer *buffer);
 
     // map/unmap a data buffer into/from display memory
+    // unmapping is deferred, see DEFERRED_UNMAP_EPOCHS
     BufferMapper* map(DataBuffer& buffer);
     void unmap(BufferMapper *mapper);
 
+    // advance the unmap epoch, called on every vsync
+    void onVsync();
+
+    // map a buffer on the worker thread so that map() finds it ready,
+    // the handle is copied and may be released once this returns
+    void premap(buffer_handle_t handle);
+
     // frame buffer management
     //return 0 if allocation fails
     virtual buffer_handle_t allocFrameBuffer(int width, int height, int *stride);
@@ -66,21 +85,62 @@ protected:
                                              buffer_handle_t handle) = 0;
     virtual BufferMapper* createBufferMapper(gralloc_module_t *module,
                                                  DataBuffer& buffer) = 0;
+    // decode all attributes of a buffer from its handle
+    virtual bool decodeBufferInfo(buffer_handle_t handle, BufferInfo& info) = 0;
 
     gralloc_module_t *mGrallocModule;
 private:
     enum {
         // make the buffer pool large enough
         DEFAULT_BUFFER_POOL_SIZE = 128,
+        // vsyncs an unreferenced mapper stays mapped, long enough for a
+        // decoder to cycle through its buffers and reuse the mapping
+        DEFERRED_UNMAP_EPOCHS = 64,
+        // vsyncs between two batches of unmapping
+        RECLAIM_INTERVAL = 16,
+        // unmap everything parked once vsync has been idle this long
+        RECLAIM_IDLE_TIMEOUT_MS = 1000,
+        // pending premap requests
+        MAX_PREMAP_COUNT = 16,
     };
 
+    // create, map and add a mapper to the pool with mLock held
+    BufferMapper* createMapperLocked(DataBuffer& buffer);
+    // unmap parked mappers which expired, or all of them
+    void reclaimMappers(bool all);
+    // map a queued mapper and publish it to the pool
+    void premapBuffer(BufferMapper *mapper);
+
     alloc_device_t *mAllocDev;
     KeyedVector<buffer_handle_t, BufferMapper*> mFrameBuffers;
     BufferCache *mBufferPool;
     DataBuffer *mDataBuffer;
     Mutex mDataBufferLock;
     Mutex mLock;
+    // unreferenced mappers waiting to be unmapped, with the epoch they
+    // were released at, protected by mLock
+    KeyedVector<BufferMapper*, int32_t> mParkedMappers;
+    volatile int32_t mEpoch;
+    // unmapped mappers waiting for the worker, protected by mLock
+    Vector<BufferMapper*> mPremapQueue;
+    Condition mWorkCondition;
+    // mappers the worker maps or unmaps outside of mLock, by buffer key;
+    // map() waits for these rather than map the same buffer a second
+    // time, as unmapping goes by the buffer's address and would tear
+    // down the other mapping too
+    KeyedVector<uint64_t, BufferMapper*> mBusyMappers;
+    Condition mBusyCondition;
+    bool mExitThread;
+    // premap statistics
+    uint32_t mPremapRequests;
+    uint32_t mPremapped;
+    uint32_t mPremapDropped;
+    uint32_t mSyncMaps;
+    uint32_t mBusyWaits;
     bool mInitialized;
+
+private:
+    DECLARE_THREAD(WorkerThread, BufferManager);
 };
 
 } // namespace intel
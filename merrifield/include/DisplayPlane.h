@@ -18,7 +18,9 @@
 
 #include <utils/KeyedVector.h>
 #include <BufferMapper.h>
+#include <GraphicBuffer.h>
 #include <Drm.h>
+#include <Dump.h>
 
 namespace android {
 namespace intel {
@@ -114,27 +116,44 @@ public:
     virtual bool initialize(uint32_t bufferCount);
     virtual void deinitialize();
 
+    // dump data buffer cache statistics
+    void dump(Dump& d);
+
 protected:
     virtual void checkPosition(int& x, int& y, int& w, int& h);
     virtual bool setDataBuffer(BufferMapper& mapper) = 0;
 private:
     inline BufferMapper* mapBuffer(DataBuffer *buffer);
+    void evictDataBuffer();
 
     inline int findActiveBuffer(BufferMapper *mapper);
     void updateActiveBuffers(BufferMapper *mapper);
     void invalidateActiveBuffers();
 protected:
+    struct CachedBuffer {
+        BufferMapper *mapper;
+        // value of mUseCount when the buffer was last set
+        uint32_t lastUse;
+        // attributes decoded when the buffer was mapped
+        BufferInfo info;
+    };
+
     int mIndex;
     int mType;
     int mZOrder;
     int mDevice;
     bool mInitialized;
 
-    // cached data buffers
-    KeyedVector<uint64_t, BufferMapper*> mDataBuffers;
+    // cached data buffers, least recently used one is evicted when full
+    KeyedVector<uint64_t, CachedBuffer> mDataBuffers;
     // holding the most recent buffers
     Vector<BufferMapper*> mActiveBuffers;
     int mCacheCapacity;
+    uint32_t mUseCount;
+    // data buffer cache statistics
+    uint32_t mCacheHits;
+    uint32_t mCacheMisses;
+    uint32_t mCacheEvictions;
 
     PlanePosition mPosition;
     crop_t mSrcCrop;
@@ -20,6 +20,7 @@
 #include <DisplayPlane.h>
 #include <HwcLayer.h>
 #include <utils/Vector.h>
+#include <utils/threads.h>
 
 namespace android {
 namespace intel {
@@ -71,6 +72,12 @@ public:
     virtual void reclaimPlane(int dsp, DisplayPlane& plane);
     virtual void disableReclaimedPlanes();
     virtual bool isOverlayPlanesDisabled();
+    // block until all overlay planes are disabled or the timeout expires,
+    // returns false on timeout
+    virtual bool waitForOverlayPlanesDisabled(nsecs_t timeout);
+    // called once posted flips have latched, wakes up the waiters if the
+    // overlays are off by now
+    virtual void onFlipComplete();
     // dump interface
     virtual void dump(Dump& d);
 
@@ -99,6 +106,11 @@ protected:
     uint32_t mFreePlanes[DisplayPlane::PLANE_MAX];
     uint32_t mReclaimedPlanes[DisplayPlane::PLANE_MAX];
 
+    // signaled once a latched flip has left all overlay planes disabled
+    Mutex mOverlayLock;
+    Condition mOverlayCondition;
+    int mOverlayWaiters;
+
     bool mInitialized;
 
 enum {
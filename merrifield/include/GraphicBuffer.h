@@ -51,6 +51,89 @@ protected:
     uint32_t mBpp;
 };
 
+// Immutable snapshot of the attributes decoded from a buffer handle.
+// It is small enough to live on the stack and, unlike the shared
+// DataBuffer returned by BufferManager::lockDataBuffer, needs no lock.
+class BufferInfo {
+public:
+    BufferInfo()
+        : mHandle(0),
+          mKey(0),
+          mFormat(DataBuffer::FORMAT_INVALID),
+          mWidth(0),
+          mHeight(0),
+          mUsage(GraphicBuffer::USAGE_INVALID),
+          mBpp(0)
+    {
+        memset(&mStride, 0, sizeof(stride_t));
+    }
+
+    BufferInfo(GraphicBuffer& buffer)
+        : mHandle(buffer.getHandle()),
+          mKey(buffer.getKey()),
+          mFormat(buffer.getFormat()),
+          mWidth(buffer.getWidth()),
+          mHeight(buffer.getHeight()),
+          mStride(buffer.getStride()),
+          mUsage(buffer.getUsage()),
+          mBpp(buffer.getBpp())
+    {
+    }
+
+    buffer_handle_t getHandle() const { return mHandle; }
+    uint64_t getKey() const { return mKey; }
+    uint32_t getFormat() const { return mFormat; }
+    uint32_t getWidth() const { return mWidth; }
+    uint32_t getHeight() const { return mHeight; }
+    const stride_t& getStride() const { return mStride; }
+    uint32_t getUsage() const { return mUsage; }
+    uint32_t getBpp() const { return mBpp; }
+
+    bool isProtected() const { return GraphicBuffer::isProtectedUsage(mUsage); }
+    bool isCompression() const { return GraphicBuffer::isCompressionUsage(mUsage); }
+
+private:
+    buffer_handle_t mHandle;
+    uint64_t mKey;
+    uint32_t mFormat;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    stride_t mStride;
+    uint32_t mUsage;
+    uint32_t mBpp;
+};
+
+// Attributes of the last few buffers one owner has seen, keyed by handle
+// and tagged with the buffer key, which is the allocation stamp, so a
+// handle freed and reused for a new allocation is decoded again. Owned
+// by a single thread, it takes no lock.
+template <size_t SIZE>
+class BufferInfoCache {
+public:
+    BufferInfoCache() : mNext(0) {}
+
+    const BufferInfo* lookup(buffer_handle_t handle, uint64_t key) const {
+        for (size_t i = 0; i < SIZE; i++) {
+            if (mInfo[i].getHandle() == handle && mInfo[i].getKey() == key) {
+                return &mInfo[i];
+            }
+        }
+        return NULL;
+    }
+
+    // replaces the oldest entry
+    const BufferInfo& add(const BufferInfo& info) {
+        BufferInfo& entry = mInfo[mNext];
+        mNext = (mNext + 1) % SIZE;
+        entry = info;
+        return entry;
+    }
+
+private:
+    BufferInfo mInfo[SIZE];
+    size_t mNext;
+};
+
 } // namespace intel
 } // namespace android
 
@@ -29,6 +29,8 @@
 #include <VsyncManager.h>
 #include <MultiDisplayObserver.h>
 #include <UeventObserver.h>
+#include <EventLoop.h>
+#include <PrepareWorker.h>
 #include <IPlatFactory.h>
 
 
@@ -84,10 +86,18 @@ public:
     MultiDisplayObserver* getMultiDisplayObserver();
     IDisplayDevice* getDisplayDevice(int disp);
     UeventObserver* getUeventObserver();
+    // loop for timers, its handlers never block
+    EventLoop* getEventLoop();
+    // loop for handlers which may block, like hotplug detection,
+    // HDCP authentication and MDS client setup
+    EventLoop* getWorkerLoop();
     IPlatFactory* getPlatFactory() {return mPlatFactory;}
 protected:
     Hwcomposer(IPlatFactory *factory);
 
+private:
+    void prepareLayers(size_t numDisplays, hwc_display_contents_1_t** displays);
+
 public:
     static Hwcomposer& getInstance() {
         Hwcomposer *instance = sInstance;
@@ -115,6 +125,8 @@ private:
     DisplayAnalyzer *mDisplayAnalyzer;
     MultiDisplayObserver *mMultiDisplayObserver;
     UeventObserver *mUeventObserver;
+    EventLoop *mEventLoop;
+    EventLoop *mWorkerLoop;
 
     // created from IPlatFactory
     DisplayPlaneManager *mPlaneManager;
@@ -123,6 +135,12 @@ private:
 
     Vector<IDisplayDevice*> mDisplayDevices;
 
+    enum {
+        // the calling thread prepares one physical display itself
+        PREPARE_WORKER_COUNT = IDisplayDevice::DEVICE_VIRTUAL - 1,
+    };
+    PrepareWorker *mPrepareWorkers[PREPARE_WORKER_COUNT];
+
     bool mInitialized;
 
 
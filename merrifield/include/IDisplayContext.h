@@ -22,6 +22,7 @@ namespace android {
 namespace intel {
 
 class HwcLayerList;
+class Dump;
 
 class IDisplayContext {
 public:
@@ -30,11 +31,21 @@ public:
 public:
     virtual bool initialize() = 0;
     virtual void deinitialize() = 0;
+    // called at the end of each display's prepare to set up its commit
+    virtual bool prepareContents(int disp, hwc_display_contents_1_t *display,
+                                 HwcLayerList *layerList) = 0;
     virtual bool commitBegin(size_t numDisplays, hwc_display_contents_1_t **displays) = 0;
     virtual bool commitContents(hwc_display_contents_1_t *display, HwcLayerList *layerList) = 0;
     virtual bool commitEnd(size_t numDisplays, hwc_display_contents_1_t **displays) = 0;
     virtual bool compositionComplete() = 0;
     virtual bool setCursorPosition(int disp, int x, int y) = 0;
+    // returns once the last committed frame has been handed to the driver,
+    // an asynchronous commit has no more than one frame in flight
+    virtual void waitForPost() = 0;
+    // hardware vsync of a pipe, flips handed to the driver before it have
+    // latched on that pipe
+    virtual void onVsync(int disp, int64_t timestamp) = 0;
+    virtual void dump(Dump& d) = 0;
 };
 
 }
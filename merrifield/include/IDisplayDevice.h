@@ -72,6 +72,10 @@ public:
     virtual ~IDisplayDevice() {}
 public:
     virtual bool prePrepare(hwc_display_contents_1_t *display) = 0;
+    // builds the layer list on geometry change, may run concurrently with
+    // other devices and must leave plane allocation to prepare(); the old
+    // list is torn down by prePrepare() as that reclaims its planes
+    virtual bool prepareLayers(hwc_display_contents_1_t *display) = 0;
     virtual bool prepare(hwc_display_contents_1_t *display) = 0;
     virtual bool commit(hwc_display_contents_1_t *display,
                           IDisplayContext *context) = 0;
@@ -48,6 +48,7 @@ public:
     virtual ~PhysicalDevice();
 public:
     virtual bool prePrepare(hwc_display_contents_1_t *display);
+    virtual bool prepareLayers(hwc_display_contents_1_t *display);
     virtual bool prepare(hwc_display_contents_1_t *display);
     virtual bool commit(hwc_display_contents_1_t *display, IDisplayContext *context);
 
@@ -80,6 +81,8 @@ public:
 
     //events
     virtual void onVsync(int64_t timestamp);
+    // recent hardware vsync timestamps and pacing statistics
+    const VsyncRing* getVsyncRing() const;
 
     virtual void dump(Dump& d);
 
@@ -16,9 +16,7 @@
 #ifndef UEVENT_OBSERVER_H
 #define UEVENT_OBSERVER_H
 
-#include <utils/KeyedVector.h>
-#include <utils/String8.h>
-#include <SimpleThread.h>
+#include <utils/Vector.h>
 
 namespace android {
 namespace intel {
@@ -35,30 +33,44 @@ public:
     bool initialize();
     void deinitialize();
     void start();
+    // listeners must be registered before start()
     void registerListener(const char *event, UeventListenerFunc func, void *data);
 
 private:
-    DECLARE_THREAD(UeventObserverThread, UeventObserver);
-    void onUevent();
+    static void onUeventFd(int fd, void *data);
+    void onUevent(int length);
+    bool attachFilter();
+    int findListener(const char *entry) const;
 
 private:
     enum {
         UEVENT_MSG_LEN = 4096,
+        // longest envelope the socket filter can match
+        MAX_FILTER_ENVELOPE = 128,
     };
 
     char mUeventMessage[UEVENT_MSG_LEN];
     int mUeventFd;
-    int mExitRDFd;
-    int mExitWDFd;
+    bool mStarted;
     struct UeventListener {
         UeventListenerFunc func;
         void *data;
     };
-    KeyedVector<String8, UeventListener*> mListeners;
+    Vector<UeventListener> mListeners;
+
+    // prefix trie over the "key=value" strings listened to, stored as
+    // first child / next sibling links, node 0 is the root
+    struct TrieNode {
+        char c;
+        int child;
+        int sibling;
+        // index in mListeners or -1
+        int listener;
+    };
+    Vector<TrieNode> mTrie;
 };
 
 } // namespace intel
 } // namespace android
 
 #endif
-
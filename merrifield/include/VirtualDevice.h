@@ -72,17 +72,21 @@ protected:
 #endif
     class BufferList {
     public:
-        BufferList(VirtualDevice& vd, const char* name, uint32_t limit, uint32_t format, uint32_t usage);
+        BufferList(VirtualDevice& vd, const char* name, uint32_t limit, uint32_t format, uint32_t usage,
+                   int memCategory);
         buffer_handle_t get(uint32_t width, uint32_t height, sp<RefBase>* heldBuffer);
         void clear();
     private:
         struct HeldBuffer;
+        uint32_t bufferSize(uint32_t width, uint32_t height) const;
+        void freeBuffer(buffer_handle_t handle, uint32_t width, uint32_t height);
         VirtualDevice& mVd;
         const char* mName;
         android::List<buffer_handle_t> mAvailableBuffers;
         const uint32_t mLimit;
         const uint32_t mFormat;
         const uint32_t mUsage;
+        const int mMemCategory;
         uint32_t mBuffersToCreate;
         uint32_t mWidth;
         uint32_t mHeight;
@@ -96,6 +100,7 @@ protected:
     struct FrameTypeChangedTask;
     struct BufferInfoChangedTask;
     struct OnFrameReadyTask;
+    struct ResetLastFrameTask;
 
     Mutex mConfigLock;
 #ifdef INTEL_WIDI
@@ -145,6 +150,15 @@ protected:
     VASurfaceID va_blank_rgb_in;
     android::KeyedVector<buffer_handle_t, android::sp<VAMappedHandleObject> > mVaMapCache;
 
+    // duplicate frame suppression
+    bool mSkipDuplicateFrames;
+    // last frame handed to the frame listener, only accessed from the WidiBlit thread
+    uint32_t mLastFrameKey;
+    uint32_t mLastFrameChecksum;
+    buffer_handle_t mLastFrameHandle;
+    android::sp<android::RefBase> mLastFrameHeldBuffer;
+    uint32_t mRepeatedFrames;
+
     bool mVspUpscale;
     bool mDebugVspClear;
     bool mDebugVspDump;
@@ -152,6 +166,7 @@ protected:
 
 private:
     android::sp<CachedBuffer> getMappedBuffer(buffer_handle_t handle);
+    bool isRepeatedFrame(uint32_t frameKey, uint32_t checksum);
 
     bool sendToWidi(hwc_display_contents_1_t *display);
     bool queueCompose(hwc_display_contents_1_t *display);
@@ -179,6 +194,7 @@ public:
 
 public:
     virtual bool prePrepare(hwc_display_contents_1_t *display);
+    virtual bool prepareLayers(hwc_display_contents_1_t *display);
     virtual bool prepare(hwc_display_contents_1_t *display);
     virtual bool commit(hwc_display_contents_1_t *display,
                           IDisplayContext *context);
@@ -680,7 +680,7 @@ bool AnnOverlayPlane::rotatedBufferReady(BufferMapper& mapper, BufferMapper* &ro
 
     if (payload->client_transform != mTransform ||
         mBobDeinterlace) {
-        if (!mRotationBufProvider->setupRotationBuffer(payload, mTransform)) {
+        if (!mRotationBufProvider->setupRotationBuffer(payload, mTransform, mDevice)) {
             DTRACE("failed to setup rotation buffer");
             return false;
         }
@@ -37,14 +37,13 @@ int DrmControl::getVideoExtCommand()
         return mVideoExtCommand;
     }
 
-    int fd = Hwcomposer::getInstance().getDrm()->getDrmFd();
+    Drm *drm = Hwcomposer::getInstance().getDrm();
 
     union drm_psb_extension_arg video_getparam_arg;
     strncpy(video_getparam_arg.extension,
             "lnc_video_getparam", sizeof(video_getparam_arg.extension));
-    int ret = drmCommandWriteRead(fd, DRM_PSB_EXTENSION,
-            &video_getparam_arg, sizeof(video_getparam_arg));
-    if (ret != 0) {
+    if (!drm->writeReadIoctl(DRM_PSB_EXTENSION,
+            &video_getparam_arg, sizeof(video_getparam_arg))) {
         VTRACE("failed to get video extension command");
         return 0;
     }
@@ -30,13 +30,13 @@ HdcpControl::HdcpControl()
       mUserData(NULL),
       mCallbackState(CALLBACK_PENDING),
       mMutex(),
-      mStoppedCondition(),
       mCompletedCondition(),
       mWaitForCompletion(false),
       mStopped(true),
       mAuthenticated(false),
       mActionDelay(0),
-      mAuthRetryCount(0)
+      mAuthRetryCount(0),
+      mTimer()
 {
 }
 
@@ -66,16 +66,16 @@ bool HdcpControl::startHdcp()
     mAuthenticated = false;
     mWaitForCompletion = false;
 
-    mThread = new HdcpControlThread(this);
-    if (!mThread.get()) {
-        ETRACE("failed to create hdcp control thread");
+    if (!startTimer()) {
+        mStopped = true;
         return false;
     }
 
     if (!runHdcp()) {
         ETRACE("failed to run HDCP");
         mStopped = true;
-        mThread = NULL;
+        // the timer is not armed yet
+        mTimer.deinitialize();
         return false;
     }
 
@@ -87,7 +87,7 @@ bool HdcpControl::startHdcp()
         mActionDelay = HDCP_AUTHENTICATION_SHORT_DELAY_MS;
     }
 
-    mThread->run("HdcpControl", PRIORITY_NORMAL);
+    mTimer.setRelative(milliseconds(mActionDelay));
 
     if (!mWaitForCompletion) {
         // HDCP is authenticated.
@@ -123,9 +123,7 @@ bool HdcpControl::startHdcpAsync(HdcpStatusCallback cb, void *userData)
         return true;
     }
 
-    mThread = new HdcpControlThread(this);
-    if (!mThread.get()) {
-        ETRACE("failed to create hdcp control thread");
+    if (!startTimer()) {
         return false;
     }
 
@@ -137,7 +135,7 @@ bool HdcpControl::startHdcpAsync(HdcpStatusCallback cb, void *userData)
     mAuthenticated = false;
     mStopped = false;
     mActionDelay = HDCP_ASYNC_START_DELAY_MS;
-    mThread->run("HdcpControl", PRIORITY_NORMAL);
+    mTimer.setRelative(milliseconds(mActionDelay));
 
     return true;
 }
@@ -151,7 +149,7 @@ bool HdcpControl::stopHdcp()
         }
 
         mStopped = true;
-        mStoppedCondition.signal();
+        signalCompletion();
 
         mAuthenticated = false;
         mWaitForCompletion = false;
@@ -160,19 +158,16 @@ bool HdcpControl::stopHdcp()
         disableAuthentication();
     } while (0);
 
-    if (mThread.get()) {
-        mThread->requestExitAndWait();
-        mThread = NULL;
-    }
+    // waits for a running timer callback, so not under the lock
+    mTimer.deinitialize();
 
     return true;
 }
 
 bool HdcpControl::enableAuthentication()
 {
-    int fd = Hwcomposer::getInstance().getDrm()->getDrmFd();
-    int ret = drmCommandNone(fd, DRM_PSB_ENABLE_HDCP);
-    if (ret != 0) {
+    Drm *drm = Hwcomposer::getInstance().getDrm();
+    if (!drm->commandIoctl(DRM_PSB_ENABLE_HDCP)) {
         ETRACE("failed to enable HDCP authentication");
         return false;
     }
@@ -181,9 +176,8 @@ bool HdcpControl::enableAuthentication()
 
 bool HdcpControl::disableAuthentication()
 {
-    int fd = Hwcomposer::getInstance().getDrm()->getDrmFd();
-    int ret = drmCommandNone(fd, DRM_PSB_DISABLE_HDCP);
-    if (ret != 0) {
+    Drm *drm = Hwcomposer::getInstance().getDrm();
+    if (!drm->commandIoctl(DRM_PSB_DISABLE_HDCP)) {
         ETRACE("failed to stop disable authentication");
         return false;
     }
@@ -202,9 +196,8 @@ bool HdcpControl::disableOverlay()
 
 bool HdcpControl::enableDisplayIED()
 {
-    int fd = Hwcomposer::getInstance().getDrm()->getDrmFd();
-    int ret = drmCommandNone(fd, DRM_PSB_HDCP_DISPLAY_IED_ON);
-    if (ret != 0) {
+    Drm *drm = Hwcomposer::getInstance().getDrm();
+    if (!drm->commandIoctl(DRM_PSB_HDCP_DISPLAY_IED_ON)) {
         ETRACE("failed to enable overlay IED");
         return false;
     }
@@ -213,9 +206,8 @@ bool HdcpControl::enableDisplayIED()
 
 bool HdcpControl::disableDisplayIED()
 {
-    int fd = Hwcomposer::getInstance().getDrm()->getDrmFd();
-    int ret = drmCommandNone(fd, DRM_PSB_HDCP_DISPLAY_IED_OFF);
-    if (ret != 0) {
+    Drm *drm = Hwcomposer::getInstance().getDrm();
+    if (!drm->commandIoctl(DRM_PSB_HDCP_DISPLAY_IED_OFF)) {
         ETRACE("failed to disable overlay IED");
         return false;
     }
@@ -224,10 +216,9 @@ bool HdcpControl::disableDisplayIED()
 
 bool HdcpControl::isHdcpSupported()
 {
-    int fd = Hwcomposer::getInstance().getDrm()->getDrmFd();
+    Drm *drm = Hwcomposer::getInstance().getDrm();
     unsigned int caps = 0;
-    int ret = drmCommandRead(fd, DRM_PSB_QUERY_HDCP, &caps, sizeof(caps));
-    if (ret != 0) {
+    if (!drm->readIoctl(DRM_PSB_QUERY_HDCP, &caps, sizeof(caps))) {
         ETRACE("failed to query HDCP capability");
         return false;
     }
@@ -242,10 +233,9 @@ bool HdcpControl::isHdcpSupported()
 
 bool HdcpControl::checkAuthenticated()
 {
-    int fd = Hwcomposer::getInstance().getDrm()->getDrmFd();
+    Drm *drm = Hwcomposer::getInstance().getDrm();
     unsigned int match = 0;
-    int ret = drmCommandRead(fd, DRM_PSB_GET_HDCP_LINK_STATUS, &match, sizeof(match));
-    if (ret != 0) {
+    if (!drm->readIoctl(DRM_PSB_GET_HDCP_LINK_STATUS, &match, sizeof(match))) {
         ETRACE("failed to get hdcp link status");
         return false;
     }
@@ -325,17 +315,33 @@ void HdcpControl::signalCompletion()
     }
 }
 
-bool HdcpControl::threadLoop()
+bool HdcpControl::startTimer()
+{
+    // authentication sleeps between its retries
+    EventLoop *loop = Hwcomposer::getInstance().getWorkerLoop();
+    if (!mTimer.initialize(loop, onTimer, this, "hdcp")) {
+        ETRACE("failed to create hdcp timer");
+        return false;
+    }
+    return true;
+}
+
+void HdcpControl::onTimer(void *data)
+{
+    HdcpControl *pThis = (HdcpControl*)data;
+    pThis->onTimer();
+}
+
+void HdcpControl::onTimer()
 {
     Mutex::Autolock lock(mMutex);
-    status_t err = mStoppedCondition.waitRelative(mMutex, milliseconds(mActionDelay));
-    if (err != -ETIMEDOUT) {
+    if (mStopped) {
         ITRACE("Hdcp is stopped.");
         signalCompletion();
-        return false;
+        return;
     }
 
-    // default is to keep thread active
+    // default is to keep the timer running
     bool ret = true;
     if (!mAuthenticated) {
         ret = runHdcp();
@@ -373,7 +379,10 @@ bool HdcpControl::threadLoop()
             (*mCallback)(mAuthenticated, mUserData);
         }
     }
-    return ret;
+
+    if (ret) {
+        mTimer.setRelative(milliseconds(mActionDelay));
+    }
 }
 
 } // namespace intel
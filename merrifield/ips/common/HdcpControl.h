@@ -17,7 +17,8 @@
 #define HDCP_CONTROL_H
 
 #include <IHdcpControl.h>
-#include <SimpleThread.h>
+#include <utils/threads.h>
+#include <EventLoop.h>
 
 namespace android {
 namespace intel {
@@ -45,6 +46,11 @@ protected:
     virtual bool postRunHdcp();
     bool runHdcp();
     inline void signalCompletion();
+    inline bool startTimer();
+
+private:
+    static void onTimer(void *data);
+    void onTimer();
 
 private:
     enum {
@@ -69,16 +75,13 @@ protected:
     void *mUserData;
     int mCallbackState;
     Mutex mMutex;
-    Condition mStoppedCondition;
     Condition mCompletedCondition;
     bool mWaitForCompletion;
     bool mStopped;
     bool mAuthenticated;
     int mActionDelay;  // in milliseconds
     uint32_t mAuthRetryCount;
-
-private:
-    DECLARE_THREAD(HdcpControlThread, HdcpControl);
+    EventTimer mTimer;
 };
 
 } // namespace intel
@@ -23,6 +23,7 @@
 #include <common/TTMBufferMapper.h>
 #include <common/GrallocSubBuffer.h>
 #include <DisplayQuery.h>
+#include <MemoryAccounting.h>
 
 
 // FIXME: remove it
@@ -298,6 +299,9 @@ OverlayBackBuffer* OverlayPlaneBase::createBackBuffer()
     backBuffer->gttOffsetInPage = gttOffsetInPage;
     backBuffer->bufObject = wsbmBufferObject;
 
+    MemoryAccounting::add(MemoryAccounting::MEM_OVERLAY_BACK_BUFFER,
+                          MemoryAccounting::DISPLAY_SHARED, size);
+
     VTRACE("cpu %p, gtt %d", virtAddr, gttOffsetInPage);
 
     return backBuffer;
@@ -313,6 +317,9 @@ void OverlayPlaneBase::deleteBackBuffer(int buf)
     if (ret == false) {
         WTRACE("failed to destroy TTM buffer");
     }
+    MemoryAccounting::remove(MemoryAccounting::MEM_OVERLAY_BACK_BUFFER,
+                             MemoryAccounting::DISPLAY_SHARED,
+                             sizeof(OverlayBackBufferBlk));
     // free back buffer
     free(mBackBuffer[buf]);
     mBackBuffer[buf] = 0;
@@ -38,8 +38,7 @@ void PrepareListener::onProtectedLayerStart(int disp)
     return;
 
     Drm *drm = Hwcomposer::getInstance().getDrm();
-    int ret = drmCommandNone(drm->getDrmFd(), DRM_PSB_HDCP_DISPLAY_IED_ON);
-    if (ret != 0) {
+    if (!drm->commandIoctl(DRM_PSB_HDCP_DISPLAY_IED_ON)) {
         ETRACE("failed to turn on display IED");
     } else {
         ITRACE("display IED is turned on");
@@ -15,6 +15,7 @@
 */
 
 #include <HwcTrace.h>
+#include <MemoryAccounting.h>
 #include <common/RotationBufferProvider.h>
 
 namespace android {
@@ -51,6 +52,7 @@ RotationBufferProvider::RotationBufferProvider(Wsbm* wsbm)
       mRotatedHeight(0),
       mRotatedStride(0),
       mTargetIndex(0),
+      mDevice(0),
       mTTMWrappers(),
       mBobDeinterlace(0)
 {
@@ -58,6 +60,8 @@ RotationBufferProvider::RotationBufferProvider(Wsbm* wsbm)
         mKhandles[i] = 0;
         mRotatedSurfaces[i] = 0;
         mDrmBuf[i] = NULL;
+        mDrmBufSize[i] = 0;
+        mDrmBufDevice[i] = 0;
     }
 }
 
@@ -215,6 +219,11 @@ bool RotationBufferProvider::createVaSurface(VideoPayloadBuffer *payload, int tr
         }
 
         mKhandles[mTargetIndex] = khandle;
+        mDrmBufSize[mTargetIndex] = stride * bufferHeight * 3 / 2;
+        mDrmBufDevice[mTargetIndex] = mDevice;
+        MemoryAccounting::add(MemoryAccounting::MEM_ROTATION_BUFFER,
+                              mDevice,
+                              mDrmBufSize[mTargetIndex]);
         vaSurfaceAttrib->buffers[0] = (uintptr_t) khandle;
         mRotatedStride = stride;
         surface = &mRotatedSurfaces[mTargetIndex];
@@ -374,7 +383,7 @@ bool RotationBufferProvider::startVA(VideoPayloadBuffer *payload, int transform)
     return true;
 }
 
-bool RotationBufferProvider::setupRotationBuffer(VideoPayloadBuffer *payload, int transform)
+bool RotationBufferProvider::setupRotationBuffer(VideoPayloadBuffer *payload, int transform, int disp)
 {
 #ifdef DEBUG_ROTATION_PERFROMANCE
     uint32_t setup_Begin = getMilliseconds();
@@ -389,6 +398,8 @@ bool RotationBufferProvider::setupRotationBuffer(VideoPayloadBuffer *payload, in
         return ret;
     }
 
+    mDevice = disp;
+
     if (payload->width > 1280 && payload->width <= 2048) {
         payload->tiling = 1;
     }
@@ -570,7 +581,14 @@ void RotationBufferProvider::freeVaSurfaces()
             ret = mWsbm->destroyTTMBuffer(mDrmBuf[i]);
             if (!ret)
                 WTRACE("failed to free TTMBuffer");
+            // only buffers that got a kernel handle were accounted
+            if (mDrmBufSize[i]) {
+                MemoryAccounting::remove(MemoryAccounting::MEM_ROTATION_BUFFER,
+                                         mDrmBufDevice[i],
+                                         mDrmBufSize[i]);
+            }
             mDrmBuf[i] = NULL;
+            mDrmBufSize[i] = 0;
         }
     }
 
@@ -43,7 +43,7 @@ public:
     bool initialize();
     void deinitialize();
     void reset();
-    bool setupRotationBuffer(VideoPayloadBuffer *payload, int transform);
+    bool setupRotationBuffer(VideoPayloadBuffer *payload, int transform, int disp);
     bool prepareBufferInfo(int, int, int, VideoPayloadBuffer *, void *);
 
 private:
@@ -86,6 +86,10 @@ private:
     buffer_handle_t mKhandles[MAX_SURFACE_NUM];
     VASurfaceID mRotatedSurfaces[MAX_SURFACE_NUM];
     void *mDrmBuf[MAX_SURFACE_NUM];
+    uint32_t mDrmBufSize[MAX_SURFACE_NUM];
+    int mDrmBufDevice[MAX_SURFACE_NUM];
+    // display the rotated surfaces are currently produced for
+    int mDevice;
 
     enum {
         TTM_WRAPPER_COUNT = 10,
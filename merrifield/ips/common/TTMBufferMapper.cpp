@@ -14,6 +14,7 @@
 // limitations under the License.
 */
 #include <HwcTrace.h>
+#include <MemoryAccounting.h>
 #include <common/TTMBufferMapper.h>
 
 namespace android {
@@ -26,7 +27,8 @@ TTMBufferMapper::TTMBufferMapper(Wsbm& wsbm, DataBuffer& buffer)
       mBufferObject(0),
       mGttOffsetInPage(0),
       mCpuAddress(0),
-      mSize(0)
+      mSize(0),
+      mAccountedSize(0)
 {
     CTRACE();
 }
@@ -73,6 +75,10 @@ bool TTMBufferMapper::map()
     mGttOffsetInPage = gttOffsetInPage;
     mCpuAddress = virtAddr;
     mSize = 0;
+
+    mAccountedSize = getStride().yuv.yStride * getHeight() * 3 / 2;
+    MemoryAccounting::add(MemoryAccounting::MEM_TTM_MAPPING,
+                          MemoryAccounting::DISPLAY_SHARED, mAccountedSize);
     return true;
 }
 
@@ -84,6 +90,9 @@ bool TTMBufferMapper::unmap()
         return false;
 
     mWsbm.unreferenceTTMBuffer(mBufferObject);
+    MemoryAccounting::remove(MemoryAccounting::MEM_TTM_MAPPING,
+                             MemoryAccounting::DISPLAY_SHARED, mAccountedSize);
+    mAccountedSize = 0;
 
     mGttOffsetInPage = 0;
     mCpuAddress = 0;
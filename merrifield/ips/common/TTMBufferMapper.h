@@ -61,6 +61,8 @@ private:
     uint32_t mGttOffsetInPage;
     void* mCpuAddress;
     uint32_t mSize;
+    // NV12 size of the wrapped buffer reported to MemoryAccounting
+    uint32_t mAccountedSize;
 };
 
 } //namespace intel
@@ -0,0 +1,151 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#ifndef TNG_COMMIT_DESCRIPTORS_H
+#define TNG_COMMIT_DESCRIPTORS_H
+
+#include <string.h>
+#include <HwcTrace.h>
+#include <hardware/hwcomposer.h>
+
+namespace android {
+namespace intel {
+
+// What commit needs of the layers with a plane of one display. Built by
+// prepare, the z order is filled in once all displays have prepared and
+// the next commit of the same contents consumes it. Plane, plane context
+// and layer list are template parameters so that test/commit_bench can
+// time these loops without a display device.
+template <typename Plane, typename Context, size_t MAX_LAYERS>
+class CommitDescriptors {
+public:
+    struct Layer {
+        hwc_layer_1_t *layer;
+        Plane *plane;
+        Context *ctx;
+    };
+
+public:
+    CommitDescriptors() { clear(); }
+
+    void clear() {
+        mContents = 0;
+        mNumHwLayers = 0;
+        mCount = 0;
+    }
+
+    bool isBuiltFor(const hwc_display_contents_1_t *display) const {
+        return mContents == display && mNumHwLayers == display->numHwLayers;
+    }
+
+    // records every layer with a buffer and a plane
+    template <typename LayerList>
+    bool build(hwc_display_contents_1_t *display, LayerList *layerList) {
+        clear();
+
+        if (!display || !layerList) {
+            return true;
+        }
+
+        for (size_t i = 0; i < display->numHwLayers; i++) {
+            if (!display->hwLayers[i].handle) {
+                continue;
+            }
+
+            Plane *plane = layerList->getPlane(i);
+            if (!plane) {
+                continue;
+            }
+
+            if (mCount >= MAX_LAYERS) {
+                ETRACE("layer count exceeds the limit");
+                mCount = 0;
+                return false;
+            }
+
+            Layer& desc = mLayers[mCount++];
+            desc.layer = &display->hwLayers[i];
+            desc.plane = plane;
+            desc.ctx = (Context *)plane->getContext();
+
+            VTRACE("count %d, handle %#x, trans %#x, blending %#x"
+                  " sourceCrop %f,%f - %fx%f, dst %d,%d - %dx%d, custom %p",
+                  mCount,
+                  desc.layer->handle,
+                  desc.layer->transform,
+                  desc.layer->blending,
+                  desc.layer->sourceCropf.left,
+                  desc.layer->sourceCropf.top,
+                  desc.layer->sourceCropf.right - desc.layer->sourceCropf.left,
+                  desc.layer->sourceCropf.bottom - desc.layer->sourceCropf.top,
+                  desc.layer->displayFrame.left,
+                  desc.layer->displayFrame.top,
+                  desc.layer->displayFrame.right - desc.layer->displayFrame.left,
+                  desc.layer->displayFrame.bottom - desc.layer->displayFrame.top,
+                  desc.ctx);
+        }
+
+        mContents = display;
+        mNumHwLayers = display->numHwLayers;
+        return true;
+    }
+
+    // copies the z order block of the plane manager into every context
+    void applyZOrder(const void *config) {
+        for (size_t i = 0; i < mCount; i++) {
+            Context *ctx = mLayers[i].ctx;
+            if (config) {
+                memcpy(&ctx->zorder, config, sizeof(ctx->zorder));
+            } else {
+                memset(&ctx->zorder, 0, sizeof(ctx->zorder));
+            }
+        }
+    }
+
+    // flips the planes and appends the layers which flipped to imgLayers
+    // and planes at count, returns false if more than max would be posted
+    template <typename ImgLayer>
+    bool commit(ImgLayer *imgLayers, Plane **planes, size_t& count, size_t max) const {
+        for (size_t i = 0; i < mCount; i++) {
+            const Layer& desc = mLayers[i];
+            if (count >= max) {
+                ETRACE("layer count exceeds the limit");
+                return false;
+            }
+
+            if (!desc.plane->flip(NULL)) {
+                VTRACE("failed to flip plane %d", i);
+                continue;
+            }
+
+            planes[count] = desc.plane;
+            imgLayers[count].psLayer = desc.layer;
+            imgLayers[count].custom = (unsigned long)desc.ctx;
+            count++;
+        }
+        return true;
+    }
+
+private:
+    hwc_display_contents_1_t *mContents;
+    size_t mNumHwLayers;
+    size_t mCount;
+    Layer mLayers[MAX_LAYERS];
+};
+
+} // namespace intel
+} // namespace android
+
+#endif /* TNG_COMMIT_DESCRIPTORS_H */
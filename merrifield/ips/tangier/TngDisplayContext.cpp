@@ -19,7 +19,14 @@
 #include <DisplayPlane.h>
 #include <IDisplayDevice.h>
 #include <HwcLayerList.h>
+#include <FrameTimings.h>
+#include <Dump.h>
 #include <tangier/TngDisplayContext.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+#include <libsync/sw_sync.h>
 
 
 namespace android {
@@ -27,10 +34,27 @@ namespace intel {
 
 TngDisplayContext::TngDisplayContext()
     : mIMGDisplayDevice(0),
+      mCommitDisplays(0),
+      mCommitDisplayCount(0),
+      mZOrderConfig(0),
+      mPostCount(0),
+      mAsyncCommit(false),
+      mFramePending(false),
+      mExitThread(false),
+      mPostWaiters(0),
+      mPostVsync(0),
       mInitialized(false),
       mCount(0)
 {
     CTRACE();
+
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        mPipes[i].timeline = -1;
+        mFramePoint[i] = 0;
+    }
+    for (int i = 0; i < MAX_SPRITE_HOLDS; i++) {
+        mHolds[i].timeline = -1;
+    }
 }
 
 TngDisplayContext::~TngDisplayContext()
@@ -57,22 +81,128 @@ bool TngDisplayContext::initialize()
         return false;
     }
 
+    for (int i = 0; i < IDisplayDevice::DEVICE_COUNT; i++) {
+        mDescriptors[i].clear();
+    }
+    mUnprepared.clear();
     mCount = 0;
+
+    // driver fences are watched on a loop of their own so that no other
+    // handler can delay them
+    if (!mFenceLoop.initialize("HwcFenceLoop")) {
+        ETRACE("failed to initialize fence loop");
+        return false;
+    }
+
+    mPostCount = 0;
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        PipeTimeline& pipe = mPipes[i];
+        memset(&pipe, 0, sizeof(pipe));
+        pipe.timeline = sw_sync_timeline_create();
+        if (pipe.timeline < 0) {
+            ETRACE("failed to create timeline for device %d", i);
+            closeTimelines();
+            mFenceLoop.deinitialize();
+            return false;
+        }
+        mFramePoint[i] = 0;
+    }
+
+    mAsyncCommit = false;
+    char prop[PROPERTY_VALUE_MAX];
+    if (property_get("hwc.commit.async.enable", prop, "0") > 0) {
+        mAsyncCommit = atoi(prop) ? true : false;
+    }
+    if (mAsyncCommit && !startCommitThread()) {
+        WTRACE("failed to start commit thread, committing synchronously");
+        stopCommitThread();
+        mAsyncCommit = false;
+    }
+
     mInitialized = true;
     return true;
 }
 
+bool TngDisplayContext::startCommitThread()
+{
+    mFramePending = false;
+    mExitThread = false;
+    mPostVsync = 0;
+    mThread = new CommitThread(this);
+    if (!mThread.get()) {
+        ETRACE("failed to create commit thread");
+        return false;
+    }
+    mThread->run("HwcCommit", PRIORITY_URGENT_DISPLAY);
+    return true;
+}
+
+void TngDisplayContext::stopCommitThread()
+{
+    if (mThread.get()) {
+        {
+            Mutex::Autolock _l(mCommitLock);
+            mExitThread = true;
+            mCommitCondition.broadcast();
+        }
+        mThread->requestExitAndWait();
+        mThread = NULL;
+    }
+
+    // a frame queued but never posted still owns its acquire fences
+    if (mFramePending) {
+        for (size_t i = 0; i < mCount; i++) {
+            if (mFrameLayers[i].acquireFenceFd != -1) {
+                close(mFrameLayers[i].acquireFenceFd);
+                mFrameLayers[i].acquireFenceFd = -1;
+            }
+        }
+        mFramePending = false;
+    }
+}
+
+bool TngDisplayContext::prepareContents(int disp, hwc_display_contents_1_t *display,
+                                        HwcLayerList *layerList)
+{
+    RETURN_FALSE_IF_NOT_INIT();
+
+    if (disp < 0 || disp >= IDisplayDevice::DEVICE_COUNT) {
+        ETRACE("invalid display %d", disp);
+        return false;
+    }
+
+    return mDescriptors[disp].build(display, layerList);
+}
+
 bool TngDisplayContext::commitBegin(size_t numDisplays, hwc_display_contents_1_t **displays)
 {
     RETURN_FALSE_IF_NOT_INIT();
+
+    // the commit thread works on the same layer arrays
+    waitForPost();
+
+    if (numDisplays > IDisplayDevice::DEVICE_COUNT) {
+        numDisplays = IDisplayDevice::DEVICE_COUNT;
+    }
+    mCommitDisplays = displays;
+    mCommitDisplayCount = numDisplays;
     mCount = 0;
+
+    // the z order block is shared by all displays and any display's
+    // prepare may change it, so it is copied into the plane contexts
+    // once all of them have prepared
+    DisplayPlaneManager *pm = Hwcomposer::getInstance().getPlaneManager();
+    mZOrderConfig = pm->getZOrderConfig();
+    for (size_t i = 0; i < numDisplays; i++) {
+        if (displays[i] && mDescriptors[i].isBuiltFor(displays[i])) {
+            mDescriptors[i].applyZOrder(mZOrderConfig);
+        }
+    }
     return true;
 }
 
 bool TngDisplayContext::commitContents(hwc_display_contents_1_t *display, HwcLayerList *layerList)
 {
-    bool ret;
-
     RETURN_FALSE_IF_NOT_INIT();
 
     if (!display || !layerList) {
@@ -80,61 +210,40 @@ bool TngDisplayContext::commitContents(hwc_display_contents_1_t *display, HwcLay
         return false;
     }
 
-    IMG_hwc_layer_t *imgLayerList = (IMG_hwc_layer_t*)mImgLayers;
-
-    for (size_t i = 0; i < display->numHwLayers; i++) {
-        if (mCount >= MAXIMUM_LAYER_NUMBER) {
-            ETRACE("layer count exceeds the limit");
-            return false;
-        }
-
-        // check layer parameters
-        if (!display->hwLayers[i].handle) {
-            continue;
+    int disp = -1;
+    for (size_t i = 0; i < mCommitDisplayCount; i++) {
+        if (mCommitDisplays[i] == display) {
+            disp = i;
+            break;
         }
+    }
+    if (disp < 0) {
+        ETRACE("contents %p are not being committed", display);
+        return false;
+    }
 
-        DisplayPlane* plane = layerList->getPlane(i);
-        if (!plane) {
-            continue;
+    DisplayDescriptors *descriptors = &mDescriptors[disp];
+    if (!descriptors->isBuiltFor(display)) {
+        VTRACE("contents %p were not prepared", display);
+        descriptors = &mUnprepared;
+        if (!mUnprepared.build(display, layerList)) {
+            return false;
         }
+        mUnprepared.applyZOrder(mZOrderConfig);
+    }
 
-        ret = plane->flip(NULL);
-        if (ret == false) {
-            VTRACE("failed to flip plane %d", i);
-            continue;
-        }
+    size_t start = mCount;
+    bool ret = descriptors->commit(mImgLayers, mPlanes, mCount, MAXIMUM_LAYER_NUMBER);
+    for (size_t i = start; i < mCount; i++) {
+        mLayers[i] = mImgLayers[i].psLayer;
+        mDisplays[i] = disp;
+        mPosted[i] = false;
+    }
 
-        IMG_hwc_layer_t *imgLayer = &imgLayerList[mCount++];
-        // update IMG layer
-        imgLayer->psLayer = &display->hwLayers[i];
-        imgLayer->custom = (unsigned long)plane->getContext();
-        struct intel_dc_plane_ctx *ctx =
-            (struct intel_dc_plane_ctx *)imgLayer->custom;
-        // update z order
-        Hwcomposer& hwc = Hwcomposer::getInstance();
-        DisplayPlaneManager *pm = hwc.getPlaneManager();
-        void *config = pm->getZOrderConfig();
-        if (config) {
-            memcpy(&ctx->zorder, config, sizeof(ctx->zorder));
-        } else {
-            memset(&ctx->zorder, 0, sizeof(ctx->zorder));
-        }
-
-        VTRACE("count %p, handle %#x, trans %#x, blending %#x"
-              " sourceCrop %f,%f - %fx%f, dst %d,%d - %dx%d, custom %#x",
-              mCount,
-              imgLayer->psLayer->handle,
-              imgLayer->psLayer->transform,
-              imgLayer->psLayer->blending,
-              imgLayer->psLayer->sourceCropf.left,
-              imgLayer->psLayer->sourceCropf.top,
-              imgLayer->psLayer->sourceCropf.right - imgLayer->psLayer->sourceCropf.left,
-              imgLayer->psLayer->sourceCropf.bottom - imgLayer->psLayer->sourceCropf.top,
-              imgLayer->psLayer->displayFrame.left,
-              imgLayer->psLayer->displayFrame.top,
-              imgLayer->psLayer->displayFrame.right - imgLayer->psLayer->displayFrame.left,
-              imgLayer->psLayer->displayFrame.bottom - imgLayer->psLayer->displayFrame.top,
-              imgLayer->custom);
+    // descriptors hold for one commit only
+    descriptors->clear();
+    if (!ret) {
+        return false;
     }
 
     layerList->postFlip();
@@ -143,19 +252,34 @@ bool TngDisplayContext::commitContents(hwc_display_contents_1_t *display, HwcLay
 
 bool TngDisplayContext::commitEnd(size_t numDisplays, hwc_display_contents_1_t **displays)
 {
-    int releaseFenceFd = -1;
+    int releaseFenceFd[IDisplayDevice::DEVICE_COUNT];
+    bool ret = true;
 
-    VTRACE("count = %d", mCount);
+    HTRACE_COUNTER(LAYER_COUNT, mCount);
 
-    if (mIMGDisplayDevice && mCount) {
-        int err = mIMGDisplayDevice->post(mIMGDisplayDevice,
-                                          mImgLayers,
-                                          mCount,
-                                          &releaseFenceFd);
-        if (err) {
-            ETRACE("post failed, err = %d", err);
-            return false;
+    if (numDisplays > IDisplayDevice::DEVICE_COUNT) {
+        numDisplays = IDisplayDevice::DEVICE_COUNT;
+    }
+
+    // layers on sprite planes get their release fences from the planes,
+    // before the post decides on reposting, all others from their pipe
+    assignHolds();
+    createReleaseFences(releaseFenceFd);
+
+    // For physical displays, dup the pipe's releaseFenceFd only for HWC
+    // layers which successfully flipped to display planes.
+    for (size_t i = 0; i < mCount; i++) {
+        if (mHold[i] >= 0) {
+            continue;
         }
+        int fence = releaseFenceFd[mDisplays[i]];
+        mLayers[i]->releaseFenceFd = (fence != -1) ? dup(fence) : -1;
+    }
+
+    if (mAsyncCommit) {
+        queueFrame();
+    } else {
+        ret = postFrame();
     }
 
     // close acquire fence
@@ -170,7 +294,6 @@ bool TngDisplayContext::commitEnd(size_t numDisplays, hwc_display_contents_1_t *
             hwc_layer_1_t& layer = display->hwLayers[j];
             if (layer.compositionType == HWC_OVERLAY) {
                 if (layer.acquireFenceFd != -1) {
-                    // sync_wait(layer.acquireFenceFd, 16ms);
                     close(layer.acquireFenceFd);
                     layer.acquireFenceFd = -1;
                 }
@@ -180,32 +303,18 @@ bool TngDisplayContext::commitEnd(size_t numDisplays, hwc_display_contents_1_t *
         // Wait and close framebuffer target layer's acquire fence
         hwc_layer_1_t& fbt = display->hwLayers[display->numHwLayers-1];
         if (fbt.acquireFenceFd != -1) {
-            // sync_wait(fbt.acquireFencdFd, 16ms);
             close(fbt.acquireFenceFd);
             fbt.acquireFenceFd = -1;
         }
 
         // Wait and close outbuf's acquire fence
         if (display->outbufAcquireFenceFd != -1) {
-            // sync_wait(display->outbufAcquireFenceFd, 16ms);
             close(display->outbufAcquireFenceFd);
             display->outbufAcquireFenceFd = -1;
         }
     }
 
-    // update release fence and retire fence
-    if (mCount > 0) {
-        // For physical displays, dup the releaseFenceFd only for
-        // HWC layers which successfully flipped to display planes
-        IMG_hwc_layer_t *imgLayerList = (IMG_hwc_layer_t*)mImgLayers;
-
-        for (unsigned int i = 0; i < mCount; i++) {
-            IMG_hwc_layer_t *imgLayer = &imgLayerList[i];
-            imgLayer->psLayer->releaseFenceFd =
-                (releaseFenceFd != -1) ? dup(releaseFenceFd) : -1;
-        }
-    }
-
+    // update retire fence
     for (size_t i = 0; i < numDisplays; i++) {
         if (!displays[i]) {
             continue;
@@ -220,23 +329,718 @@ bool TngDisplayContext::commitEnd(size_t numDisplays, hwc_display_contents_1_t *
         }
 
         // retireFence is used for SurfaceFlinger to do DispSync;
-        // dup releaseFenceFd for physical displays and ignore virtual
-        // display; we don't distinguish between release and retire, and all
-        // physical displays are using a single releaseFence; for virtual
-        // display, fencing is handled by the VirtualDisplay class
+        // dup the pipe's own releaseFenceFd for physical displays and
+        // ignore virtual display; we don't distinguish between release and
+        // retire; for virtual display, fencing is handled by the
+        // VirtualDisplay class
         if (i < IDisplayDevice::DEVICE_VIRTUAL) {
             displays[i]->retireFenceFd =
-                (releaseFenceFd != -1) ? dup(releaseFenceFd) : -1;
+                (releaseFenceFd[i] != -1) ? dup(releaseFenceFd[i]) : -1;
+        }
+    }
+
+    // close original release fence fds
+    for (size_t i = 0; i < IDisplayDevice::DEVICE_COUNT; i++) {
+        if (releaseFenceFd[i] != -1) {
+            close(releaseFenceFd[i]);
+        }
+    }
+    return ret;
+}
+
+void TngDisplayContext::createReleaseFences(int *releaseFenceFd)
+{
+    bool hasLayers[IDisplayDevice::DEVICE_COUNT];
+    for (int i = 0; i < IDisplayDevice::DEVICE_COUNT; i++) {
+        releaseFenceFd[i] = -1;
+        hasLayers[i] = false;
+    }
+
+    for (size_t i = 0; i < mCount; i++) {
+        hasLayers[mDisplays[i]] = true;
+    }
+
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        PipeTimeline& pipe = mPipes[i];
+        mFramePoint[i] = 0;
+        if (!hasLayers[i] || pipe.timeline < 0) {
+            continue;
         }
+        releaseFenceFd[i] = sw_sync_fence_create(pipe.timeline, "hwc_release",
+                                                 pipe.value + 1);
+        if (releaseFenceFd[i] < 0) {
+            WTRACE("failed to create release fence on device %d", i);
+            releaseFenceFd[i] = -1;
+            continue;
+        }
+        mFramePoint[i] = ++pipe.value;
     }
+}
 
-    // close original release fence fd
-    if (releaseFenceFd != -1) {
-        close(releaseFenceFd);
+bool TngDisplayContext::postFrame()
+{
+    StageTimer fenceTimer(FrameTimings::STAGE_FENCE_WAIT);
+    HTRACE_BEGIN(FENCE_WAIT, mCount);
+    if (waitAcquireFences()) {
+        repostLateLayers();
+    }
+    bool ready = acquireFencesSignaled();
+    HTRACE_END(FENCE_WAIT);
+    fenceTimer.stop();
+
+    // a single post configures all pipes
+    StageTimer postTimer(FrameTimings::STAGE_POST);
+    int fence = -1;
+    int err = 0;
+    if (mIMGDisplayDevice && mCount) {
+        HTRACE_SCOPE(POST, mCount);
+        err = mIMGDisplayDevice->post(mIMGDisplayDevice,
+                                      mImgLayers,
+                                      mCount,
+                                      &fence);
+    }
+    nsecs_t postTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    postTimer.stop();
+
+    if (err) {
+        ETRACE("post failed, err = %d", err);
+        fence = -1;
     }
+
+    for (size_t i = 0; i < mCount; i++) {
+        mPosted[i] = !err;
+    }
+
+    // the driver waits for outstanding acquire fences itself, a vsync is
+    // then no proof that the post has latched
+    if (mCount) {
+        trackPost(fence, !err, ready ? postTime : 0);
+        saveHoldFrames();
+    }
+    return !err;
+}
+
+void TngDisplayContext::trackPost(int fence, bool posted, nsecs_t postTime)
+{
+    // a failed post leaves the last frame on screen, its points are
+    // signaled along with those of the next post which does latch
+    if (!posted) {
+        return;
+    }
+
+    bool hasLayers[IDisplayDevice::DEVICE_COUNT];
+    memset(hasLayers, 0, sizeof(hasLayers));
+    bool onPlane[MAX_SPRITE_HOLDS];
+    memset(onPlane, 0, sizeof(onPlane));
+
+    PipeLatch latches[IDisplayDevice::DEVICE_VIRTUAL];
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        latches[i].holdCount = 0;
+    }
+
+    for (size_t i = 0; i < mCount; i++) {
+        hasLayers[mDisplays[i]] = true;
+        int slot = mHold[i];
+        if (slot < 0) {
+            continue;
+        }
+        onPlane[slot] = true;
+
+        // a reposted layer leaves the previous buffer on screen, a flip to
+        // this one releases all buffers before it
+        uint32_t value = mHoldValue[i] - 1;
+        if (!mReposted[i] && value > mHolds[slot].requested) {
+            PipeLatch& latch = latches[mDisplays[i]];
+            latch.hold[latch.holdCount] = slot;
+            latch.holdValue[latch.holdCount++] = value;
+            mHolds[slot].requested = value;
+        }
+    }
+
+    // a plane dropped from its display releases all it holds
+    for (int slot = 0; slot < MAX_SPRITE_HOLDS; slot++) {
+        SpriteHold& hold = mHolds[slot];
+        if (hold.timeline >= 0 && !onPlane[slot] && hold.value > hold.requested &&
+            hold.disp < IDisplayDevice::DEVICE_VIRTUAL) {
+            PipeLatch& latch = latches[hold.disp];
+            latch.hold[latch.holdCount] = slot;
+            latch.holdValue[latch.holdCount++] = hold.value;
+            hold.requested = hold.value;
+        }
+    }
+
+    Mutex::Autolock _l(mFenceLock);
+    mPostCount++;
+
+    PostRetire retire;
+    retire.post = mPostCount;
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        PipeTimeline& pipe = mPipes[i];
+        PipeLatch& latch = latches[i];
+        retire.value[i] = pipe.value;
+
+        latch.post = mPostCount;
+        latch.latchTime = 0;
+        if (hasLayers[i]) {
+            latch.release = mFramePoint[i] ? mFramePoint[i] - 1 : pipe.value;
+            latch.postTime = postTime;
+        } else {
+            // nothing of this post shows on the pipe
+            latch.release = pipe.value;
+            latch.postTime = 0;
+            if (latch.release <= pipe.signaled && !latch.holdCount) {
+                continue;
+            }
+        }
+
+        // behind a flip which has not latched yet the driver queues the
+        // post, the next vsync would not be its own
+        for (size_t j = 0; j < pipe.count; j++) {
+            if (!pipe.latches[(pipe.first + j) % MAX_PENDING_LATCHES].latchTime) {
+                latch.postTime = 0;
+            }
+        }
+        addLatchLocked(i, latch);
+    }
+
+    int watchFd = fence;
+    if (watchFd != -1) {
+        mRetireFences.add(watchFd, retire);
+        if (!mFenceLoop.addFd(watchFd, onRetireFence, this, "retire fence")) {
+            mRetireFences.removeItem(watchFd);
+            close(watchFd);
+            watchFd = -1;
+        }
+    }
+
+    if (watchFd == -1) {
+        // nothing to wait for, the post is as good as retired
+        retireLocked(retire);
+    }
+}
+
+void TngDisplayContext::addLatchLocked(int disp, const PipeLatch& latch)
+{
+    PipeTimeline& pipe = mPipes[disp];
+
+    // latches taken by vsync are kept for the statistics only
+    if (pipe.count == MAX_PENDING_LATCHES &&
+        pipe.latches[pipe.first].latchTime) {
+        pipe.first = (pipe.first + 1) % MAX_PENDING_LATCHES;
+        pipe.count--;
+    }
+
+    if (pipe.count < MAX_PENDING_LATCHES) {
+        pipe.latches[(pipe.first + pipe.count) % MAX_PENDING_LATCHES] = latch;
+        pipe.count++;
+        return;
+    }
+
+    // driver fences stopped signaling, fold the post into the last one,
+    // which only its driver fence releases then
+    PipeLatch& last = pipe.latches[(pipe.first + pipe.count - 1) % MAX_PENDING_LATCHES];
+    last.post = latch.post;
+    last.release = latch.release;
+    last.postTime = 0;
+    last.latchTime = 0;
+    for (size_t i = 0; i < latch.holdCount; i++) {
+        size_t j = 0;
+        while (j < last.holdCount && last.hold[j] != latch.hold[i]) {
+            j++;
+        }
+        if (j == last.holdCount) {
+            last.hold[last.holdCount++] = latch.hold[i];
+        }
+        last.holdValue[j] = latch.holdValue[i];
+    }
+}
+
+void TngDisplayContext::applyLatchLocked(int disp, const PipeLatch& latch)
+{
+    signalTimelineLocked(disp, latch.release);
+
+    for (size_t i = 0; i < latch.holdCount; i++) {
+        SpriteHold& hold = mHolds[latch.hold[i]];
+        if (latch.holdValue[i] > hold.signaled) {
+            sw_sync_timeline_inc(hold.timeline, latch.holdValue[i] - hold.signaled);
+            hold.signaled = latch.holdValue[i];
+        }
+    }
+}
+
+void TngDisplayContext::signalTimelineLocked(int disp, uint32_t value)
+{
+    PipeTimeline& pipe = mPipes[disp];
+    if (value > pipe.signaled) {
+        sw_sync_timeline_inc(pipe.timeline, value - pipe.signaled);
+        pipe.signaled = value;
+    }
+}
+
+void TngDisplayContext::onVsync(int disp, int64_t timestamp)
+{
+    if (disp < 0 || disp >= IDisplayDevice::DEVICE_VIRTUAL) {
+        return;
+    }
+
+    bool flipped = false;
+    {
+        Mutex::Autolock _l(mFenceLock);
+        PipeTimeline& pipe = mPipes[disp];
+        if (pipe.timeline < 0) {
+            return;
+        }
+
+        // the flips of a post the driver took before this vsync latched at
+        // it, along with those of all posts before
+        size_t latched = 0;
+        for (size_t i = 0; i < pipe.count; i++) {
+            const PipeLatch& latch = pipe.latches[(pipe.first + i) % MAX_PENDING_LATCHES];
+            if (latch.postTime && latch.postTime < timestamp) {
+                latched = i + 1;
+            }
+        }
+
+        for (size_t i = 0; i < latched; i++) {
+            PipeLatch& latch = pipe.latches[(pipe.first + i) % MAX_PENDING_LATCHES];
+            if (latch.latchTime) {
+                continue;
+            }
+            HTRACE_INSTANT(PIPE_LATCH, disp, latch.post, 1);
+            latch.latchTime = timestamp;
+            applyLatchLocked(disp, latch);
+            pipe.vsyncLatches++;
+            flipped = true;
+        }
+    }
+
+    if (flipped) {
+        Hwcomposer::getInstance().getPlaneManager()->onFlipComplete();
+    }
+}
+
+void TngDisplayContext::onRetireFence(int fd, void *data)
+{
+    TngDisplayContext *context = (TngDisplayContext *)data;
+    context->retirePost(fd);
+}
+
+void TngDisplayContext::retirePost(int fd)
+{
+    {
+        Mutex::Autolock _l(mFenceLock);
+        ssize_t index = mRetireFences.indexOfKey(fd);
+        if (index < 0) {
+            return;
+        }
+        retireLocked(mRetireFences.valueAt(index));
+        mRetireFences.removeItemsAt(index);
+    }
+
+    // called on the loop thread, removing does not wait
+    mFenceLoop.removeFd(fd);
+    close(fd);
+
+    // a post dropping an overlay turns it off once the post has latched
+    Hwcomposer::getInstance().getPlaneManager()->onFlipComplete();
+}
+
+void TngDisplayContext::retireLocked(const PostRetire& retire)
+{
+    // the driver fence of a post signals once the next post has latched
+    // on every pipe, which is when that one's latch is taken at the latest
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        PipeTimeline& pipe = mPipes[i];
+        while (pipe.count) {
+            PipeLatch& latch = pipe.latches[pipe.first];
+            if (latch.post > retire.post + 1) {
+                break;
+            }
+
+            if (latch.latchTime) {
+                nsecs_t lead = now - latch.latchTime;
+                pipe.leadSum += lead;
+                pipe.leadCount++;
+                if (lead > pipe.leadMax) {
+                    pipe.leadMax = lead;
+                }
+            } else {
+                HTRACE_INSTANT(PIPE_LATCH, i, latch.post, 0);
+                applyLatchLocked(i, latch);
+                pipe.fenceLatches++;
+            }
+            pipe.first = (pipe.first + 1) % MAX_PENDING_LATCHES;
+            pipe.count--;
+        }
+        signalTimelineLocked(i, retire.value[i]);
+    }
+}
+
+void TngDisplayContext::queueFrame()
+{
+    HTRACE_SCOPE(QUEUE_FRAME, mCount);
+
+    // the layers from SurfaceFlinger are only valid during this call, the
+    // commit thread gets copies owning their acquire fences
+    for (size_t i = 0; i < mCount; i++) {
+        hwc_layer_1_t *layer = mLayers[i];
+        hwc_layer_1_t& copy = mFrameLayers[i];
+        copy = *layer;
+        copy.acquireFenceFd = (layer->acquireFenceFd != -1) ? dup(layer->acquireFenceFd) : -1;
+        copy.releaseFenceFd = -1;
+        copy.visibleRegionScreen.numRects = 0;
+        copy.visibleRegionScreen.rects = NULL;
+        mLayers[i] = &copy;
+        mImgLayers[i].psLayer = &copy;
+    }
+
+    Mutex::Autolock _l(mCommitLock);
+    mFramePending = true;
+    mCommitCondition.broadcast();
+}
+
+void TngDisplayContext::waitForPost()
+{
+    if (!mAsyncCommit) {
+        return;
+    }
+
+    Mutex::Autolock _l(mCommitLock);
+    if (!mFramePending) {
+        return;
+    }
+
+    // the commit thread stops aligning the post once someone waits for it
+    mPostWaiters++;
+    mCommitCondition.broadcast();
+    while (mFramePending) {
+        mCommitCondition.wait(mCommitLock);
+    }
+    mPostWaiters--;
+}
+
+bool TngDisplayContext::threadLoop()
+{
+    {
+        Mutex::Autolock _l(mCommitLock);
+        while (!mFramePending && !mExitThread) {
+            mCommitCondition.wait(mCommitLock);
+        }
+        if (mExitThread) {
+            return false;
+        }
+    }
+
+    alignPost();
+    postFrame();
+
+    // the vsync this post aims at
+    VsyncManager *vsyncManager = Hwcomposer::getInstance().getVsyncManager();
+    mPostVsync = vsyncManager ?
+        vsyncManager->getNextVsync(systemTime(SYSTEM_TIME_MONOTONIC)) : 0;
+
+    for (size_t i = 0; i < mCount; i++) {
+        if (mFrameLayers[i].acquireFenceFd != -1) {
+            close(mFrameLayers[i].acquireFenceFd);
+            mFrameLayers[i].acquireFenceFd = -1;
+        }
+    }
+
+    Mutex::Autolock _l(mCommitLock);
+    mFramePending = false;
+    mCommitCondition.broadcast();
     return true;
 }
 
+void TngDisplayContext::alignPost()
+{
+    if (!mPostVsync) {
+        return;
+    }
+
+    // a post queued behind one which has not latched yet waits in the
+    // driver, wait for the vsync the last post aims at here instead and
+    // post at the same phase after it every frame
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t when = mPostVsync + POST_PHASE_OFFSET_US * 1000LL;
+    if (when <= now || when - now > milliseconds(FENCE_DEFAULT_TIMEOUT_MS)) {
+        // already past it, or the prediction is off
+        return;
+    }
+
+    // a prepare waiting for the post gains nothing from the alignment
+    HTRACE_SCOPE(ALIGN_POST, (int)((when - now) / 1000));
+    Mutex::Autolock _l(mCommitLock);
+    while (!mPostWaiters && !mExitThread && now < when) {
+        mCommitCondition.waitRelative(mCommitLock, when - now);
+        now = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+}
+
+int TngDisplayContext::getPlaneHold(DisplayPlane *plane, int disp)
+{
+    int slot = plane->getIndex();
+    if (slot < 0 || slot >= MAX_SPRITE_HOLDS) {
+        return -1;
+    }
+
+    SpriteHold& hold = mHolds[slot];
+    if (hold.timeline < 0) {
+        hold.timeline = sw_sync_timeline_create();
+        if (hold.timeline < 0) {
+            WTRACE("failed to create hold timeline for plane %d", slot);
+            return -1;
+        }
+        hold.value = 0;
+        hold.requested = 0;
+        hold.signaled = 0;
+        hold.hasFrame = false;
+    }
+    hold.disp = disp;
+    return slot;
+}
+
+void TngDisplayContext::assignHolds()
+{
+    for (size_t i = 0; i < mCount; i++) {
+        mHold[i] = -1;
+        if (mDisplays[i] >= IDisplayDevice::DEVICE_VIRTUAL ||
+            mPlanes[i]->getType() != DisplayPlane::PLANE_SPRITE) {
+            continue;
+        }
+
+        int slot = getPlaneHold(mPlanes[i], mDisplays[i]);
+        if (slot < 0) {
+            continue;
+        }
+
+        SpriteHold& hold = mHolds[slot];
+        int fence = sw_sync_fence_create(hold.timeline, "hwc_hold", hold.value + 1);
+        if (fence < 0) {
+            WTRACE("failed to create hold fence on plane %d", mPlanes[i]->getIndex());
+            continue;
+        }
+        hold.value++;
+        mHold[i] = slot;
+        mHoldValue[i] = hold.value;
+        mLayers[i]->releaseFenceFd = fence;
+    }
+}
+
+void TngDisplayContext::closeTimelines()
+{
+    KeyedVector<int, PostRetire> fences;
+    {
+        Mutex::Autolock _l(mFenceLock);
+        fences = mRetireFences;
+        mRetireFences.clear();
+    }
+    for (size_t i = 0; i < fences.size(); i++) {
+        mFenceLoop.removeFd(fences.keyAt(i));
+        close(fences.keyAt(i));
+    }
+
+    // destroying a timeline signals all of its fences
+    Mutex::Autolock _l(mFenceLock);
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        if (mPipes[i].timeline >= 0) {
+            close(mPipes[i].timeline);
+        }
+        mPipes[i].timeline = -1;
+        mPipes[i].count = 0;
+    }
+    for (int i = 0; i < MAX_SPRITE_HOLDS; i++) {
+        if (mHolds[i].timeline >= 0) {
+            close(mHolds[i].timeline);
+        }
+        mHolds[i].timeline = -1;
+    }
+}
+
+void TngDisplayContext::dump(Dump& d)
+{
+    Mutex::Autolock _l(mFenceLock);
+
+    d.append("Display context state:\n");
+    d.append("  %s commit, posts %u\n",
+             mAsyncCommit ? "async (one frame in flight)" : "sync", mPostCount);
+    for (int i = 0; i < IDisplayDevice::DEVICE_VIRTUAL; i++) {
+        const PipeTimeline& pipe = mPipes[i];
+        d.append("  pipe %d: point %u, signaled %u, pending posts %zu\n",
+                 i, pipe.value, pipe.signaled, pipe.count);
+        d.append("    latched by vsync %u, by driver fence %u,"
+                 " vsync ahead of driver fence avg %lld us max %lld us\n",
+                 pipe.vsyncLatches, pipe.fenceLatches,
+                 pipe.leadCount ? (long long)(pipe.leadSum / pipe.leadCount / 1000) : 0LL,
+                 (long long)(pipe.leadMax / 1000));
+    }
+}
+
+nsecs_t TngDisplayContext::getFrameDeadline()
+{
+    const nsecs_t margin = FENCE_DEADLINE_MARGIN_US * 1000LL;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    VsyncManager *vsyncManager = Hwcomposer::getInstance().getVsyncManager();
+    nsecs_t vsync = vsyncManager ? vsyncManager->getNextVsync(now + margin) : 0;
+    if (!vsync) {
+        return now + milliseconds(FENCE_DEFAULT_TIMEOUT_MS);
+    }
+    return vsync - margin;
+}
+
+size_t TngDisplayContext::waitAcquireFences()
+{
+    struct pollfd fds[MAXIMUM_LAYER_NUMBER];
+    size_t pending = 0;
+
+    for (size_t i = 0; i < mCount; i++) {
+        mLate[i] = false;
+        mReposted[i] = false;
+        fds[i].fd = canRepost(i) ? mLayers[i]->acquireFenceFd : -1;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+        if (fds[i].fd != -1) {
+            pending++;
+        }
+    }
+
+    if (!pending) {
+        return 0;
+    }
+
+    // a fence fd polls readable once signaled, poll skips negative fds
+    nsecs_t deadline = getFrameDeadline();
+    while (pending) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (now >= deadline) {
+            break;
+        }
+
+        int timeout = (int)((deadline - now + 999999) / 1000000);
+        int ret = poll(fds, mCount, timeout);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ETRACE("failed to poll acquire fences, error = %d", errno);
+            return 0;
+        }
+
+        for (size_t i = 0; i < mCount; i++) {
+            if (fds[i].fd != -1 && fds[i].revents) {
+                // an errored fence won't get better by waiting for it
+                fds[i].fd = -1;
+                pending--;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < mCount; i++) {
+        if (fds[i].fd != -1) {
+            HTRACE_INSTANT(LATE_LAYER, i, fds[i].fd);
+            mLate[i] = true;
+        }
+    }
+    return pending;
+}
+
+bool TngDisplayContext::canRepost(size_t index)
+{
+    // only buffers on sprite planes are held, overlay registers are
+    // rewritten in place and the primary plane carries the UI
+    int slot = mHold[index];
+    if (slot < 0) {
+        return false;
+    }
+
+    // SurfaceFlinger may reuse a buffer it no longer has a hold fence
+    // for, such a frame must not be shown again
+    const SpriteHold& hold = mHolds[slot];
+    return hold.hasFrame && hold.frameDisp == mDisplays[index] &&
+           hold.layer.handle != mLayers[index]->handle;
+}
+
+void TngDisplayContext::repostLateLayers()
+{
+    for (size_t i = 0; i < mCount; i++) {
+        if (!mLate[i]) {
+            continue;
+        }
+
+        SpriteHold& hold = mHolds[mHold[i]];
+        IMG_hwc_layer_t *imgLayer = &mImgLayers[i];
+        struct intel_dc_plane_ctx *ctx =
+            (struct intel_dc_plane_ctx *)imgLayer->custom;
+        memcpy(&hold.ctx.zorder, &ctx->zorder, sizeof(hold.ctx.zorder));
+
+        HTRACE_INSTANT(REPOST, i);
+        imgLayer->psLayer = &hold.layer;
+        imgLayer->custom = (unsigned long)&hold.ctx;
+        mReposted[i] = true;
+    }
+}
+
+bool TngDisplayContext::acquireFencesSignaled()
+{
+    struct pollfd fds[MAXIMUM_LAYER_NUMBER];
+    size_t count = 0;
+
+    for (size_t i = 0; i < mCount; i++) {
+        int fd = mImgLayers[i].psLayer->acquireFenceFd;
+        if (fd == -1) {
+            continue;
+        }
+        fds[count].fd = fd;
+        fds[count].events = POLLIN;
+        fds[count].revents = 0;
+        count++;
+    }
+
+    if (!count) {
+        return true;
+    }
+    return poll(fds, count, 0) == (int)count;
+}
+
+void TngDisplayContext::saveHoldFrames()
+{
+    bool onPlane[MAX_SPRITE_HOLDS];
+    memset(onPlane, 0, sizeof(onPlane));
+
+    for (size_t i = 0; i < mCount; i++) {
+        int slot = mHold[i];
+        if (slot < 0) {
+            continue;
+        }
+        onPlane[slot] = true;
+
+        // a reposted or failed layer leaves the last frame on screen
+        if (!mPosted[i] || mReposted[i]) {
+            continue;
+        }
+
+        SpriteHold& hold = mHolds[slot];
+        hold.layer = *mLayers[i];
+        // the copy outlives the layer list, keep no references into it
+        hold.layer.acquireFenceFd = -1;
+        hold.layer.releaseFenceFd = -1;
+        hold.layer.visibleRegionScreen.numRects = 0;
+        hold.layer.visibleRegionScreen.rects = NULL;
+        memcpy(&hold.ctx, (void *)mImgLayers[i].custom, sizeof(hold.ctx));
+        hold.hasFrame = true;
+        hold.frameDisp = mDisplays[i];
+    }
+
+    // a plane dropped from the post has nothing left to repost
+    for (int slot = 0; slot < MAX_SPRITE_HOLDS; slot++) {
+        if (!onPlane[slot]) {
+            mHolds[slot].hasFrame = false;
+        }
+    }
+}
+
 bool TngDisplayContext::compositionComplete()
 {
     return true;
@@ -263,6 +1067,12 @@ bool TngDisplayContext::setCursorPosition(int disp, int x, int y)
 
 void TngDisplayContext::deinitialize()
 {
+    stopCommitThread();
+    mAsyncCommit = false;
+    closeTimelines();
+    // all fence handlers are removed by now
+    mFenceLoop.deinitialize();
+
     mIMGDisplayDevice = 0;
 
     mCount = 0;
@@ -17,7 +17,14 @@
 #define TNG_DISPLAY_CONTEXT_H
 
 #include <IDisplayContext.h>
+#include <IDisplayDevice.h>
+#include <DisplayPlane.h>
 #include <hal_public.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+#include <SimpleThread.h>
+#include <EventLoop.h>
+#include <tangier/TngCommitDescriptors.h>
 
 typedef struct
 {
@@ -43,20 +50,196 @@ public:
 public:
     bool initialize();
     void deinitialize();
+    bool prepareContents(int disp, hwc_display_contents_1_t *display,
+                         HwcLayerList *layerList);
     bool commitBegin(size_t numDisplays, hwc_display_contents_1_t **displays);
     bool commitContents(hwc_display_contents_1_t *display, HwcLayerList* layerList);
     bool commitEnd(size_t numDisplays, hwc_display_contents_1_t **displays);
     bool compositionComplete();
     bool setCursorPosition(int disp, int x, int y);
+    void waitForPost();
+    void onVsync(int disp, int64_t timestamp);
+    void dump(Dump& d);
+
+private:
+    struct PipeLatch;
+    struct PostRetire;
+    // frame deadline ahead of the next vsync
+    nsecs_t getFrameDeadline();
+    // polls the acquire fences of the layers which could be reposted
+    // until they signal or the frame deadline passes, returns the number
+    // of late ones; the driver waits for all other fences itself
+    size_t waitAcquireFences();
+    bool canRepost(size_t index);
+    // reposts the last frame of sprite planes whose new buffer is late
+    void repostLateLayers();
+    // whether the driver has no acquire fence to wait for in this post
+    bool acquireFencesSignaled();
+    void saveHoldFrames();
+    // hands out the release fences of layers on sprite planes from the
+    // hold timeline of their plane
+    void assignHolds();
+    int getPlaneHold(DisplayPlane *plane, int disp);
+    // hands out a point on the timeline of each pipe with layers, the
+    // release and retire fence of this frame on that pipe
+    void createReleaseFences(int *releaseFenceFd);
+    // posts the committed layers of all displays at once
+    bool postFrame();
+    // hands the committed layers to the commit thread
+    void queueFrame();
+    bool startCommitThread();
+    void stopCommitThread();
+    // waits for the vsync the last post aims at before the next one,
+    // unless a prepare is waiting for the post
+    void alignPost();
+    // records what the post releases on each pipe once it latches there,
+    // and watches its driver fence; postTime is 0 if only the driver
+    // fence may tell that the post latched
+    void trackPost(int fence, bool posted, nsecs_t postTime);
+    void addLatchLocked(int disp, const PipeLatch& latch);
+    void applyLatchLocked(int disp, const PipeLatch& latch);
+    void retireLocked(const PostRetire& retire);
+    void signalTimelineLocked(int disp, uint32_t value);
+    static void onRetireFence(int fd, void *data);
+    void retirePost(int fd);
+    void closeTimelines();
 
 private:
     enum {
         MAXIMUM_LAYER_NUMBER = 20,
+        // margin ahead of vsync for the post to make the flip
+        FENCE_DEADLINE_MARGIN_US = 2000,
+        // deadline used when no vsync has been seen yet
+        FENCE_DEFAULT_TIMEOUT_MS = 16,
+        // sprite planes with a hold timeline, by plane index
+        MAX_SPRITE_HOLDS = 2,
+        // phase after vsync the commit thread posts at
+        POST_PHASE_OFFSET_US = 1000,
+        // posts a pipe tracks until their driver fences signal
+        MAX_PENDING_LATCHES = 4,
+    };
+
+    typedef CommitDescriptors<DisplayPlane, struct intel_dc_plane_ctx,
+                              MAXIMUM_LAYER_NUMBER> DisplayDescriptors;
+
+    // the release fence of a buffer on a sprite plane is a point on the
+    // plane's hold timeline, which only advances once a post flipping to
+    // another buffer (or dropping the plane) latches, so the last frame
+    // of the plane can be posted again in place of a late buffer
+    struct SpriteHold {
+        int disp;
+        int timeline;
+        // last point handed out
+        uint32_t value;
+        // last point a release was requested for
+        uint32_t requested;
+        // last point signaled, protected by mFenceLock
+        uint32_t signaled;
+        // last frame posted on the plane, and its display
+        bool hasFrame;
+        int frameDisp;
+        hwc_layer_1_t layer;
+        struct intel_dc_plane_ctx ctx;
+    };
+
+    // what a post releases on one pipe once it has latched there: the
+    // frames before it on the pipe's timeline and the buffers it flipped
+    // the sprite planes of the pipe away from
+    struct PipeLatch {
+        uint32_t post;
+        uint32_t release;
+        // when the post returned, 0 if a vsync may not latch it
+        nsecs_t postTime;
+        // vsync the post latched at, 0 until then
+        nsecs_t latchTime;
+        size_t holdCount;
+        int hold[MAX_SPRITE_HOLDS];
+        uint32_t holdValue[MAX_SPRITE_HOLDS];
+    };
+
+    // release fences of a pipe are points on its own sw_sync timeline.
+    // The driver fence of a post only signals once the next post has
+    // latched on every pipe, so a pipe's points are signaled at the first
+    // vsync of that pipe after a post which the driver took with no flip
+    // pending and no acquire fence to wait for, and otherwise once the
+    // driver fence of the post before signals. Protected by mFenceLock
+    // except for value, which only the committing thread touches
+    struct PipeTimeline {
+        int timeline;
+        // last point handed out
+        uint32_t value;
+        uint32_t signaled;
+        PipeLatch latches[MAX_PENDING_LATCHES];
+        size_t first;
+        size_t count;
+        // latched by vsync and by driver fence, and how far ahead of the
+        // driver fence a vsync released
+        uint32_t vsyncLatches;
+        uint32_t fenceLatches;
+        nsecs_t leadSum;
+        nsecs_t leadMax;
+        uint32_t leadCount;
     };
+
+    // points of all pipes to signal once the driver fence of a post does
+    struct PostRetire {
+        uint32_t post;
+        uint32_t value[IDisplayDevice::DEVICE_VIRTUAL];
+    };
+
     IMG_display_device_public_t *mIMGDisplayDevice;
     IMG_hwc_layer_t mImgLayers[MAXIMUM_LAYER_NUMBER];
+    DisplayDescriptors mDescriptors[IDisplayDevice::DEVICE_COUNT];
+    // for contents committed without being prepared
+    DisplayDescriptors mUnprepared;
+    // plane, display and layer of each posted layer, the layers of a
+    // display are contiguous
+    DisplayPlane *mPlanes[MAXIMUM_LAYER_NUMBER];
+    int mDisplays[MAXIMUM_LAYER_NUMBER];
+    hwc_layer_1_t *mLayers[MAXIMUM_LAYER_NUMBER];
+    bool mPosted[MAXIMUM_LAYER_NUMBER];
+    bool mLate[MAXIMUM_LAYER_NUMBER];
+    bool mReposted[MAXIMUM_LAYER_NUMBER];
+    // hold of each posted layer, -1 if it has none
+    int mHold[MAXIMUM_LAYER_NUMBER];
+    uint32_t mHoldValue[MAXIMUM_LAYER_NUMBER];
+    SpriteHold mHolds[MAX_SPRITE_HOLDS];
+    hwc_display_contents_1_t **mCommitDisplays;
+    size_t mCommitDisplayCount;
+    // z order block of the plane manager, final once commit begins
+    const void *mZOrderConfig;
+
+    PipeTimeline mPipes[IDisplayDevice::DEVICE_VIRTUAL];
+    // point of the frame being committed on each pipe, 0 if none
+    uint32_t mFramePoint[IDisplayDevice::DEVICE_VIRTUAL];
+    uint32_t mPostCount;
+    // watches driver fences, only fence handlers run on it
+    EventLoop mFenceLoop;
+    Mutex mFenceLock;
+    KeyedVector<int, PostRetire> mRetireFences;
+
+    // asynchronous commit, off unless hwc.commit.async.enable is set: the
+    // frame committed by SurfaceFlinger is posted from the commit thread.
+    // Only one frame is in flight, the plane contexts, overlay back
+    // buffers and plane reclaim of the next prepare are shared with the
+    // frame being posted, so the next prepare waits for the post and a
+    // driver stall still blocks SurfaceFlinger
+    bool mAsyncCommit;
+    Mutex mCommitLock;
+    Condition mCommitCondition;
+    bool mFramePending;
+    bool mExitThread;
+    // prepares waiting for the post, which then stops aligning it
+    int mPostWaiters;
+    // vsync the last post of the commit thread aims at
+    nsecs_t mPostVsync;
+    hwc_layer_1_t mFrameLayers[MAXIMUM_LAYER_NUMBER];
+
     bool mInitialized;
     size_t mCount;
+
+private:
+    DECLARE_THREAD(CommitThread, TngDisplayContext);
 };
 
 } // namespace intel
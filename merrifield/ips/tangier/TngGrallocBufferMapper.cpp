@@ -16,6 +16,7 @@
 #include <HwcTrace.h>
 #include <Drm.h>
 #include <Hwcomposer.h>
+#include <MemoryAccounting.h>
 #include <tangier/TngGrallocBufferMapper.h>
 #include <common/WsbmWrapper.h>
 
@@ -26,7 +27,9 @@ TngGrallocBufferMapper::TngGrallocBufferMapper(IMG_gralloc_module_public_t& modu
                                                     DataBuffer& buffer)
     : GrallocBufferMapperBase(buffer),
       mIMGGrallocModule(reinterpret_cast<IMG_gralloc_module_t&>(module)),
-      mBufferObject(0)
+      mBufferObject(0),
+      mAccounted(false),
+      mAccountedSize(0)
 {
     CTRACE();
 
@@ -152,6 +155,11 @@ bool TngGrallocBufferMapper::map()
     }
 
     if (i == SUB_BUFFER_MAX) {
+        // remember what was reported, unmap() must remove exactly that
+        mAccounted = true;
+        mAccountedSize = getMappedSize();
+        MemoryAccounting::add(MemoryAccounting::MEM_GTT_MAPPING,
+                              MemoryAccounting::DISPLAY_SHARED, mAccountedSize);
         return true;
     }
 
@@ -168,6 +176,16 @@ bool TngGrallocBufferMapper::map()
     return false;
 }
 
+uint32_t TngGrallocBufferMapper::getMappedSize() const
+{
+    uint32_t size = 0;
+    for (int i = 0; i < SUB_BUFFER_MAX; i++) {
+        if (mCpuAddress[i])
+            size += mSize[i];
+    }
+    return size;
+}
+
 bool TngGrallocBufferMapper::unmap()
 {
     int i;
@@ -175,6 +193,13 @@ bool TngGrallocBufferMapper::unmap()
 
     CTRACE();
 
+    if (mAccounted) {
+        MemoryAccounting::remove(MemoryAccounting::MEM_GTT_MAPPING,
+                                 MemoryAccounting::DISPLAY_SHARED, mAccountedSize);
+        mAccounted = false;
+        mAccountedSize = 0;
+    }
+
     for (i = 0; i < SUB_BUFFER_MAX; i++) {
         if (mCpuAddress[i])
             gttUnmap(mCpuAddress[i]);
@@ -39,11 +39,14 @@ private:
     bool gttMap(void *vaddr, uint32_t size, uint32_t gttAlign, int *offset);
     bool gttUnmap(void *vaddr);
     bool mapKhandle();
+    uint32_t getMappedSize() const;
 
 private:
     IMG_gralloc_module_t& mIMGGrallocModule;
     void* mBufferObject;
 	native_handle_t* mClonedHandle;
+    bool mAccounted;
+    uint32_t mAccountedSize;
 };
 
 } // namespace intel
@@ -166,7 +166,7 @@ bool TngOverlayPlane::rotatedBufferReady(BufferMapper& mapper, BufferMapper* &ro
         mBobDeinterlace) {
         payload->hwc_timestamp = systemTime();
         payload->layer_transform = mTransform;
-        if (!mRotationBufProvider->setupRotationBuffer(payload, mTransform)) {
+        if (!mRotationBufProvider->setupRotationBuffer(payload, mTransform, mDevice)) {
             ETRACE("failed to setup rotation buffer");
             return false;
         }
@@ -27,10 +27,13 @@ LOCAL_SRC_FILES := \
     ../../common/base/Drm.cpp \
     ../../common/base/HwcLayer.cpp \
     ../../common/base/HwcLayerList.cpp \
+    ../../common/base/LayerStats.cpp \
     ../../common/base/Hwcomposer.cpp \
     ../../common/base/HwcModule.cpp \
     ../../common/base/DisplayAnalyzer.cpp \
     ../../common/base/VsyncManager.cpp \
+    ../../common/base/VsyncModel.cpp \
+    ../../common/base/PrepareWorker.cpp \
     ../../common/buffers/BufferCache.cpp \
     ../../common/buffers/GraphicBuffer.cpp \
     ../../common/buffers/BufferManager.cpp \
@@ -39,12 +42,17 @@ LOCAL_SRC_FILES := \
     ../../common/devices/ExternalDevice.cpp \
     ../../common/devices/VirtualDevice.cpp \
     ../../common/observers/UeventObserver.cpp \
+    ../../common/observers/EventLoop.cpp \
     ../../common/observers/VsyncEventObserver.cpp \
     ../../common/observers/SoftVsyncObserver.cpp \
+    ../../common/observers/VsyncRing.cpp \
     ../../common/observers/MultiDisplayObserver.cpp \
     ../../common/planes/DisplayPlane.cpp \
     ../../common/planes/DisplayPlaneManager.cpp \
-    ../../common/utils/Dump.cpp
+    ../../common/utils/Dump.cpp \
+    ../../common/utils/MemoryAccounting.cpp \
+    ../../common/utils/FrameTimings.cpp \
+    ../../common/utils/HwcTraceBuffer.cpp
 
 
 LOCAL_SRC_FILES += \
@@ -43,6 +43,23 @@ void PlatfBufferManager::deinitialize()
     BufferManager::deinitialize();
 }
 
+bool PlatfBufferManager::decodeBufferInfo(buffer_handle_t handle, BufferInfo& info)
+{
+    if (!handle) {
+        return false;
+    }
+
+    // decode on the stack rather than re-targeting the shared data buffer
+    TngGrallocBuffer buffer(handle);
+    info = BufferInfo(buffer);
+    return true;
+}
+
+uint64_t PlatfBufferManager::getBufferKey(buffer_handle_t handle)
+{
+    return handle ? ((TngIMGGrallocBuffer *)handle)->ui64Stamp : 0;
+}
+
 DataBuffer* PlatfBufferManager::createDataBuffer(gralloc_module_t *module,
                                                  buffer_handle_t handle)
 {
@@ -34,6 +34,8 @@ protected:
     DataBuffer* createDataBuffer(gralloc_module_t *module, buffer_handle_t handle);
     BufferMapper* createBufferMapper(gralloc_module_t *module,
                                         DataBuffer& buffer);
+    bool decodeBufferInfo(buffer_handle_t handle, BufferInfo& info);
+    uint64_t getBufferKey(buffer_handle_t handle);
     bool blit(buffer_handle_t srcHandle, buffer_handle_t destHandle,
               const crop_t& destRect, bool filter, bool async);
 };
@@ -24,3 +24,47 @@ LOCAL_C_INCLUDES := \
 # Build the binary to $(TARGET_OUT_DATA_NATIVE_TESTS)/$(LOCAL_MODULE)
 # to integrate with auto-test framework.
 include $(BUILD_EXECUTABLE)
+
+# BufferCache microbenchmark
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_buffer_cache_bench
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    buffer_cache_bench.cpp \
+    ../common/buffers/BufferCache.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libutils \
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/../include \
+    $(LOCAL_PATH)/../common/buffers \
+    $(LOCAL_PATH)/../common/utils \
+
+include $(BUILD_EXECUTABLE)
+
+# TngDisplayContext commit path microbenchmark
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_commit_bench
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    commit_bench.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libutils \
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/../ips \
+    $(LOCAL_PATH)/../common/utils \
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,137 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Timers.h>
+
+#include <BufferCache.h>
+
+using namespace android;
+using namespace android::intel;
+
+// Compares BufferCache against the sorted KeyedVector it replaced, with
+// the access pattern of BufferManager::map/unmap: mostly lookups of
+// mapped buffers plus a steady churn of buffers being mapped and unmapped.
+
+#define ITERATIONS 200000
+#define LOOKUPS_PER_CHURN 4
+
+class DummyMapper : public BufferMapper {
+public:
+    DummyMapper(DataBuffer& buffer) : BufferMapper(buffer) {}
+    virtual bool map() { return true; }
+    virtual bool unmap() { return true; }
+    virtual uint32_t getGttOffsetInPage(int subIndex) const { return 0; }
+    virtual void* getCpuAddress(int subIndex) const { return 0; }
+    virtual uint32_t getSize(int subIndex) const { return 0; }
+    virtual buffer_handle_t getKHandle(int subIndex) { return 0; }
+    virtual buffer_handle_t getFbHandle(int subIndex) { return 0; }
+    virtual void putFbHandle() {}
+};
+
+// the previous BufferCache implementation
+class KeyedVectorCache {
+public:
+    KeyedVectorCache(int size) { mBufferPool.setCapacity(size); }
+    bool addMapper(uint64_t handle, BufferMapper* mapper) {
+        if (mBufferPool.indexOfKey(handle) >= 0)
+            return false;
+        return mBufferPool.add(handle, mapper) >= 0;
+    }
+    bool removeMapper(BufferMapper* mapper) {
+        return mBufferPool.removeItem(mapper->getKey()) >= 0;
+    }
+    BufferMapper* getMapper(uint64_t handle) {
+        ssize_t index = mBufferPool.indexOfKey(handle);
+        return index < 0 ? 0 : mBufferPool.valueAt(index);
+    }
+private:
+    KeyedVector<uint64_t, BufferMapper*> mBufferPool;
+};
+
+static uint64_t nextKey(uint64_t *seed)
+{
+    // gralloc stamps are mostly increasing with gaps
+    *seed += 1 + (rand() & 0xff);
+    return *seed;
+}
+
+template <typename Cache>
+static nsecs_t run(size_t entries, DummyMapper **mappers, size_t count)
+{
+    Cache cache(entries);
+    size_t head = 0;
+    for (size_t i = 0; i < entries; i++)
+        cache.addMapper(mappers[i]->getKey(), mappers[i]);
+
+    size_t hits = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        // lookups of live buffers
+        for (size_t j = 0; j < LOOKUPS_PER_CHURN; j++) {
+            size_t index = head + ((i * 7 + j * 13) % entries);
+            if (cache.getMapper(mappers[index % count]->getKey()))
+                hits++;
+        }
+        // unmap the oldest buffer, map a new one
+        cache.removeMapper(mappers[head % count]);
+        DummyMapper *mapper = mappers[(head + entries) % count];
+        cache.addMapper(mapper->getKey(), mapper);
+        head++;
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    for (size_t i = head; i < head + entries; i++)
+        cache.removeMapper(mappers[i % count]);
+
+    if (hits != ITERATIONS * LOOKUPS_PER_CHURN)
+        printf("  unexpected misses: %zu\n", ITERATIONS * LOOKUPS_PER_CHURN - hits);
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 32, 128, 512 };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t entries = sizes[s];
+        // wraps around only after ITERATIONS, so live keys are always unique
+        size_t count = ITERATIONS + entries;
+        DummyMapper **mappers = new DummyMapper*[count];
+        uint64_t seed = 0;
+        srand(entries);
+        for (size_t i = 0; i < count; i++) {
+            DataBuffer buffer((buffer_handle_t)(uintptr_t)nextKey(&seed));
+            mappers[i] = new DummyMapper(buffer);
+        }
+
+        nsecs_t vector = run<KeyedVectorCache>(entries, mappers, count);
+        nsecs_t hash = run<BufferCache>(entries, mappers, count);
+        size_t ops = ITERATIONS * (LOOKUPS_PER_CHURN + 2);
+        printf("%4zu entries: KeyedVector %6.1f ns/op, BufferCache %6.1f ns/op (%.1fx)\n",
+               entries,
+               (double)vector / ops,
+               (double)hash / ops,
+               hash ? (double)vector / hash : 0.0);
+
+        for (size_t i = 0; i < count; i++)
+            delete mappers[i];
+        delete[] mappers;
+    }
+    return 0;
+}
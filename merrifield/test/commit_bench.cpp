@@ -0,0 +1,184 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils/Timers.h>
+
+#include <tangier/TngCommitDescriptors.h>
+
+using namespace android;
+using namespace android::intel;
+
+// Times the commit path of TngDisplayContext per layer count: the
+// CommitDescriptors loops it runs against the per layer loop they
+// replaced, which looked up the plane and the z order block and copied
+// it for every layer on every commit. Planes, the plane manager and the
+// driver structures are stand-ins with the same shape and virtual
+// dispatch as the HWC ones.
+
+#define ITERATIONS 200000
+#define MAXIMUM_LAYER_NUMBER 20
+
+struct DummyZOrder {
+    unsigned int forceBottom[3];
+    unsigned int abovePrimary;
+};
+
+struct DummyContext {
+    unsigned int type;
+    unsigned int ctx[24];
+    DummyZOrder zorder;
+};
+
+struct DummyImgLayer {
+    hwc_layer_1_t *psLayer;
+    unsigned long custom;
+};
+
+class DummyPlane {
+public:
+    DummyPlane() : mFlips(0) { memset(&mContext, 0, sizeof(mContext)); }
+    virtual ~DummyPlane() {}
+    virtual bool flip(void *ctx) { mFlips++; return true; }
+    virtual void* getContext() const { return (void *)&mContext; }
+private:
+    unsigned int mFlips;
+    DummyContext mContext;
+};
+
+class DummyPlaneManager {
+public:
+    virtual ~DummyPlaneManager() {}
+    virtual void* getZOrderConfig() const { return (void *)&mZOrder; }
+    DummyZOrder mZOrder;
+};
+
+class DummyLayerList {
+public:
+    virtual ~DummyLayerList() {}
+    virtual DummyPlane* getPlane(size_t index) const { return mPlanes[index]; }
+    DummyPlane *mPlanes[MAXIMUM_LAYER_NUMBER];
+};
+
+typedef CommitDescriptors<DummyPlane, DummyContext, MAXIMUM_LAYER_NUMBER> Descriptors;
+
+static DummyPlaneManager sPlaneManager;
+
+// stands in for Hwcomposer::getInstance().getPlaneManager()
+static DummyPlaneManager* __attribute__((noinline)) getPlaneManager()
+{
+    return &sPlaneManager;
+}
+
+// the previous TngDisplayContext::commitContents loop
+static size_t commitPerLayer(hwc_display_contents_1_t *display,
+                             DummyLayerList *list, DummyImgLayer *imgLayers)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < display->numHwLayers; i++) {
+        if (!display->hwLayers[i].handle)
+            continue;
+        DummyPlane *plane = list->getPlane(i);
+        if (!plane)
+            continue;
+        if (!plane->flip(NULL))
+            continue;
+
+        DummyImgLayer *imgLayer = &imgLayers[count++];
+        imgLayer->psLayer = &display->hwLayers[i];
+        imgLayer->custom = (unsigned long)plane->getContext();
+        DummyContext *ctx = (DummyContext *)imgLayer->custom;
+        void *config = getPlaneManager()->getZOrderConfig();
+        if (config)
+            memcpy(&ctx->zorder, config, sizeof(ctx->zorder));
+        else
+            memset(&ctx->zorder, 0, sizeof(ctx->zorder));
+    }
+    return count;
+}
+
+// commitBegin copies the z order, commitContents walks the descriptors
+static size_t commitDescriptors(Descriptors& descriptors,
+                                DummyImgLayer *imgLayers, DummyPlane **planes)
+{
+    size_t count = 0;
+    descriptors.applyZOrder(getPlaneManager()->getZOrderConfig());
+    descriptors.commit(imgLayers, planes, count, MAXIMUM_LAYER_NUMBER);
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t counts[] = { 1, 2, 4, 8, 16 };
+
+    memset(&sPlaneManager.mZOrder, 0, sizeof(sPlaneManager.mZOrder));
+
+    DummyPlane planes[MAXIMUM_LAYER_NUMBER];
+    DummyPlane *posted[MAXIMUM_LAYER_NUMBER];
+    DummyImgLayer imgLayers[MAXIMUM_LAYER_NUMBER];
+    Descriptors descriptors;
+
+    printf("per commit, %d iterations\n", ITERATIONS);
+    printf("layers | per layer loop | descriptors | speedup | prepare\n");
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        size_t layers = counts[c];
+        // the framebuffer target is the last layer of the list
+        size_t size = sizeof(hwc_display_contents_1_t) +
+                      (layers + 1) * sizeof(hwc_layer_1_t);
+        hwc_display_contents_1_t *display =
+            (hwc_display_contents_1_t *)calloc(1, size);
+        display->numHwLayers = layers + 1;
+
+        DummyLayerList list;
+        memset(list.mPlanes, 0, sizeof(list.mPlanes));
+        for (size_t i = 0; i < layers; i++) {
+            display->hwLayers[i].handle = (buffer_handle_t)(i + 1);
+            list.mPlanes[i] = &planes[i];
+        }
+
+        ssize_t balance = 0;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < ITERATIONS; i++)
+            balance += commitPerLayer(display, &list, imgLayers);
+        nsecs_t perLayer = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        // building runs in prepare, once per frame but outside of commit
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < ITERATIONS; i++)
+            descriptors.build(display, &list);
+        nsecs_t prepare = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < ITERATIONS; i++)
+            balance -= commitDescriptors(descriptors, imgLayers, posted);
+        nsecs_t commit = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        if (balance)
+            printf("  posted layer mismatch: %zd\n", balance);
+        printf("%6zu | %11.1f ns | %8.1f ns | %6.2fx | %4.1f ns\n",
+               layers,
+               (double)perLayer / ITERATIONS,
+               (double)commit / ITERATIONS,
+               commit ? (double)perLayer / commit : 0.0,
+               (double)prepare / ITERATIONS);
+
+        free(display);
+    }
+    return 0;
+}
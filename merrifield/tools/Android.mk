@@ -0,0 +1,17 @@
+# Host tools
+LOCAL_PATH:= $(call my-dir)
+
+# Binary trace decoder
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := hwc_trace_decode
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := \
+    hwc_trace_decode.cpp \
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/../common/utils \
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,217 @@
+/*
+// Copyright (c) 2014 Intel Corporation 
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <HwcTraceFormat.h>
+
+// Converts a binary hwc trace snapshot, written by the hwc dump when
+// debug.hwc.trace.file is set, into Chrome trace event JSON which loads
+// in chrome://tracing and the Perfetto UI:
+//
+//   adb shell setprop debug.hwc.trace.file /data/local/tmp/hwc.trace
+//   adb shell dumpsys SurfaceFlinger
+//   adb pull /data/local/tmp/hwc.trace
+//   hwc_trace_decode hwc.trace hwc.json
+
+static void writeString(FILE *out, const char *str, size_t size)
+{
+    fputc('"', out);
+    for (size_t i = 0; i < size && str[i]; i++) {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// expands the integer conversions of an event format, anything else in
+// the format is copied as is so a bad format can not read past the args
+static void formatArgs(char *buf, size_t size, const char *format,
+                       const int32_t *args)
+{
+    size_t len = 0;
+    int arg = 0;
+
+    buf[0] = 0;
+    for (const char *p = format; *p && len + 1 < size; p++) {
+        if (*p != '%') {
+            buf[len++] = *p;
+            buf[len] = 0;
+            continue;
+        }
+
+        char spec[16];
+        size_t specLen = 0;
+        spec[specLen++] = *p++;
+        while (*p && strchr("-+ #0123456789", *p) && specLen < sizeof(spec) - 2) {
+            spec[specLen++] = *p++;
+        }
+        if (!*p) {
+            break;
+        }
+        if (*p == '%') {
+            buf[len++] = '%';
+            buf[len] = 0;
+            continue;
+        }
+        if (!strchr("diuxX", *p) || arg >= HWC_TRACE_ARG_COUNT) {
+            continue;
+        }
+        spec[specLen++] = *p;
+        spec[specLen] = 0;
+        int n = snprintf(buf + len, size - len, spec, args[arg++]);
+        if (n > 0) {
+            len += n;
+            if (len >= size) {
+                len = size - 1;
+            }
+        }
+    }
+}
+
+static bool readAll(FILE *in, void *data, size_t size)
+{
+    return fread(data, 1, size, in) == size;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <trace> [output.json]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "failed to open %s\n", argv[1]);
+        return 1;
+    }
+    FILE *out = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "failed to open %s\n", argv[2]);
+        fclose(in);
+        return 1;
+    }
+
+    HwcTraceFileHeader header;
+    if (!readAll(in, &header, sizeof(header)) ||
+        header.magic != HWC_TRACE_MAGIC) {
+        fprintf(stderr, "%s is not a hwc trace\n", argv[1]);
+        return 1;
+    }
+    if (header.version != HWC_TRACE_VERSION ||
+        header.recordSize != sizeof(HwcTraceRecord)) {
+        fprintf(stderr, "unsupported trace version %u, record size %u\n",
+                header.version, header.recordSize);
+        return 1;
+    }
+
+    HwcTraceEventInfo *events =
+        (HwcTraceEventInfo *)calloc(header.eventCount + 1, sizeof(HwcTraceEventInfo));
+    if (!events || !readAll(in, events, header.eventCount * sizeof(HwcTraceEventInfo))) {
+        fprintf(stderr, "truncated event table\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < header.eventCount; i++) {
+        events[i].name[HWC_TRACE_NAME_SIZE - 1] = 0;
+        events[i].format[HWC_TRACE_FORMAT_SIZE - 1] = 0;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    uint32_t total = 0;
+
+    for (uint32_t t = 0; t < header.threadCount; t++) {
+        HwcTraceThreadInfo thread;
+        if (!readAll(in, &thread, sizeof(thread))) {
+            fprintf(stderr, "truncated thread %u\n", t);
+            break;
+        }
+
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":", first ? "" : ",\n", header.pid, thread.tid);
+        writeString(out, thread.name, sizeof(thread.name));
+        fprintf(out, "}}");
+        first = false;
+
+        for (uint32_t i = 0; i < thread.recordCount; i++) {
+            HwcTraceRecord r;
+            if (!readAll(in, &r, sizeof(r))) {
+                fprintf(stderr, "truncated records of thread %d\n", thread.tid);
+                t = header.threadCount;
+                break;
+            }
+
+            char unknown[HWC_TRACE_NAME_SIZE];
+            const char *name = unknown;
+            const char *format = "";
+            if (r.event < header.eventCount) {
+                name = events[r.event].name;
+                format = events[r.event].format;
+            } else {
+                snprintf(unknown, sizeof(unknown), "event%u", r.event);
+            }
+
+            fprintf(out, ",\n{\"name\":");
+            writeString(out, name, HWC_TRACE_NAME_SIZE);
+            fprintf(out, ",\"cat\":\"hwc\",\"ph\":\"%c\",\"ts\":%lld.%03d,\"pid\":%d,\"tid\":%d",
+                    r.phase, (long long)(r.timestamp / 1000), (int)(r.timestamp % 1000),
+                    header.pid, thread.tid);
+
+            char msg[256];
+            switch (r.phase) {
+            case HWC_TRACE_PHASE_BEGIN:
+            case HWC_TRACE_PHASE_INSTANT:
+                if (r.phase == HWC_TRACE_PHASE_INSTANT) {
+                    fprintf(out, ",\"s\":\"t\"");
+                }
+                formatArgs(msg, sizeof(msg), format, r.args);
+                if (msg[0]) {
+                    fprintf(out, ",\"args\":{\"msg\":");
+                    writeString(out, msg, sizeof(msg));
+                    fprintf(out, "}");
+                }
+                break;
+            case HWC_TRACE_PHASE_COUNTER:
+                fprintf(out, ",\"args\":{");
+                writeString(out, name, HWC_TRACE_NAME_SIZE);
+                fprintf(out, ":%d}", r.args[0]);
+                break;
+            default:
+                break;
+            }
+            fprintf(out, "}");
+            total++;
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+    fprintf(stderr, "%u records of %u threads\n", total, header.threadCount);
+
+    free(events);
+    fclose(in);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}